@@ -5,7 +5,8 @@
 //       This code contains the FSM logic of operation 
 //       of elevator, the motor controller logic, reads 
 //       inputs from keypad and ir sensors. PWM to 
-//	 control the speed of motor.
+//	 control the speed of motor. SCI carries a binary
+//       telemetry stream for debugging on a host PC.
 // Note: The code for LCD is reused from the previous
 //       lab assignments.LCD is used only for debugging
 //*****************************************************
@@ -17,11 +18,22 @@
 #define ENABLE_BIT 0x80
 #define RS_BIT 0x40
 
+#define LCD_COLS 16                  // DDRAM cells shown per line
+#define LCD_ROWS 2                   // Lines, line 2 starts at DDRAM 0x40
+#define LCD_CELLS (LCD_COLS * LCD_ROWS)
+#define LCD_AT_IR   0                // Sensor status, 9 cells: "IRn" or "IRErr" and the bits
+#define LCD_AT_XIRQ LCD_COLS         // Keypad status, 10 cells: "XIRQ" and the entry count
+
 void LCDInit(void);
 void LCDdelay(unsigned long ms);
 void spiWR(unsigned char data);
 void LCDWR(unsigned char data);
 void LCDChar(unsigned char letter);
+void LCDData(unsigned char letter);
+void LCDGoto(unsigned char cell);
+void LCDSetCursor(unsigned char cell);
+void LCDRefresh(void);
+void LCDDigits(unsigned int val, unsigned char *digit);
 void LCDNum(int val);
 void LCDClear(void);
 void LCDCursorOn(void);
@@ -31,6 +43,17 @@ void LCDDecimal(unsigned char val);
 void LCDInt(unsigned int val);
 void LCDHex(unsigned char val);
 
+// The LCD functions write into lcdFrame only. LCDRefresh, from the main
+// loop, sends the cells that differ from lcdShown, so handlers never wait
+// on the SPI and unchanged characters are never sent again. Each status
+// field is written at its own cells, so a repeated status sends nothing.
+// XIRQ puts the cursor back when it is done, as it can land in the middle
+// of an IRQ side write.
+unsigned char lcdFrame[LCD_CELLS];            // What the code wants shown
+unsigned char lcdShown[LCD_CELLS];            // What the panel shows
+unsigned volatile char lcdCursor = 0;         // Next cell LCDChar writes
+unsigned volatile char lcdDirty = 0;          // lcdFrame written since refresh
+
 void Timer_Init(void);               // Timer Initialization 
 void Timer_Wait10ms(void);           // Timer for delay  
 void motorStop(void);		     // Stop motor for at each level
@@ -42,17 +65,13 @@ void Init(void);                     // Port initialization
 int ReadInput(void);                 // Read input from PTT
 void scan(void);                     // Pull each line and Scan the keypad 
 void scanInput(int value);           // Scan and assign values for PTT
-void scanIRSensor(void);             // Scan IR sensor
+unsigned char scanIRSensor(void);    // Scan IR sensor, 0 if not one level lit
 void motorController(void);          // Motor Controller logic.
-
-unsigned volatile int level1 = 0;    // Button 1 (inside elevator) 0 : false , 1: true
-unsigned volatile int level2 = 0;    // Button 2 (inside elevator) 0 : false , 1: true
-unsigned volatile int level3 = 0;    // Button 3 (inside elevator) 0 : false , 1: true
-unsigned volatile int up1 = 0;       // Up button (at level 1) (outside elevator) 0 : false , 1: true
-unsigned volatile int down2 = 0;     // Down button (at level 2) (outside elevator) 0 : false , 1: true
-unsigned volatile int up2 = 0;       // Up button (at level 2) (outside elevator) 0 : false , 1: true
-unsigned volatile int down3 = 0;     // Down button (at level 3) (outside elevator) 0 : false , 1: true
-
+void interrupt 14 TickHan(void);     // TC6 system tick handler
+void wdArm(void);                    // Start timing the segment to the next sensor
+void wdSensor(void);                 // Check a sensor against the watchdog
+void wdTick(void);                   // Watchdog timeouts and recovery steps
+void motorCreep(unsigned char dir);  // Run the motor at creep speed
 
 unsigned volatile int button = 0;        // Current IR sensor. 1: level1, 2 : level2, 3: level3
 unsigned volatile int currentstate = 1;  // State variable for FSM 
@@ -63,12 +82,197 @@ unsigned volatile int direction = 0;     // to control motor direction. 1: UP (c
 void PWM_Init(void);                      // PWM initializer
 void PWM_Duty(unsigned char duty);        // Setting duty cycle for PWM
 
+#define TICK_PERIOD 2500                  // TC6 period: 4us * 2500 = 10ms
+unsigned volatile int ticks = 0;          // System time in 10ms ticks, wraps
+
+// Call bits, one per keypad call
+#define CALL_LEVEL1 0x01                  // Button 1 (inside elevator)
+#define CALL_LEVEL2 0x02                  // Button 2 (inside elevator)
+#define CALL_LEVEL3 0x04                  // Button 3 (inside elevator)
+#define CALL_UP1    0x08                  // Up button (at level 1) (outside elevator)
+#define CALL_UP2    0x10                  // Up button (at level 2) (outside elevator)
+#define CALL_DOWN2  0x20                  // Down button (at level 2) (outside elevator)
+#define CALL_DOWN3  0x40                  // Down button (at level 3) (outside elevator)
+#define CALL_COUNT  7
+
+#define PENDING(calls) ((pendingCalls & (calls)) != 0)
+
+#define CALL_DEADLINE 3000                // Ticks (30s) after which a call is forced
+#define AGE_BUCKETS   8                   // Age histogram: bucket n < 0.64s << n
+#define AGE_TICKS     1000                // AGE record period: 10s
+
+// Calls are registered by XIRQ and served from IRQ. XIRQ cannot be
+// masked, so the two sides never write the same variable: XIRQ only sets
+// its callBox entry, IRQ merges the box into pendingCalls and only ever
+// clears pendingCalls. A press that lands while IRQ is deciding stays in
+// the box for the next merge instead of being reset with the old call.
+unsigned volatile char callBox[CALL_COUNT];   // Set by XIRQ, cleared by callMerge
+unsigned volatile int callStamp[CALL_COUNT];  // Tick of the first boxed press
+unsigned char pendingCalls = 0;               // Registered calls, IRQ side only
+unsigned int callTime[CALL_COUNT];            // Tick each pending call was registered
+const unsigned char callFloor[CALL_COUNT] = {1, 2, 3, 1, 2, 2, 3};
+unsigned int callAgeHist[AGE_BUCKETS];        // Call ages at service time, saturate
+unsigned int ageStart = 0;                    // Tick of the last AGE record
+
+unsigned char callMask(void);             // Pending and boxed calls
+unsigned char callIndex(unsigned char call);
+void callPress(unsigned char call);       // Box a call, stamp its time (XIRQ)
+void callMerge(void);                     // Move boxed calls to pendingCalls
+void callServe(unsigned char call);       // Clear a call, record its age
+unsigned int callAge(unsigned char calls);    // Age of the oldest of calls
+unsigned char callDue(void);              // Floor of a call past the deadline
+
+// Traffic mode. XIRQ counts call arrivals into the current bucket of a
+// sliding window; every bucket period TickHan moves the window on, sums
+// it and classifies the traffic. A new mode has to be seen at two
+// evaluations in a row before it becomes active. The mode picks where an
+// idle car parks. TickHan times how long the car has stood with no calls,
+// and the car only parks once that reaches PARK_TICKS, so it does not
+// leave with someone who has just got on and not pressed a button yet.
+#define TRAFFIC_BUCKETS      8            // Window: 8 buckets of 60s = 8 minutes
+#define TRAFFIC_BUCKET_TICKS 6000
+#define TRAFFIC_IDLE_ENTER   3            // Fewer calls in the window: idle
+#define TRAFFIC_IDLE_LEAVE   6            // Calls needed to leave idle
+#define TRAFFIC_PEAK_MIN     6            // Hall calls needed to call a peak
+#define PARK_TICKS           1000         // Stand idle this long before parking (10s)
+
+#define MODE_IDLE       0                 // Stay where the car stopped
+#define MODE_UPPEAK     1                 // Return to the lobby (level 1)
+#define MODE_DOWNPEAK   2                 // Park at the top (level 3)
+#define MODE_INTERFLOOR 3                 // Park in the middle (level 2)
+
+unsigned char trafficCount[TRAFFIC_BUCKETS][CALL_COUNT];  // Arrivals, XIRQ counts
+unsigned volatile char trafficNow = 0;    // Bucket XIRQ counts into
+unsigned int trafficStart = 0;            // Tick the current bucket began
+unsigned char trafficMode = MODE_IDLE;    // Active dispatch policy
+unsigned char trafficSeen = MODE_IDLE;    // Mode classified at the last evaluation
+unsigned volatile int parkIdle = 0;       // Ticks stood with no calls, up to PARK_TICKS
+
+void trafficTick(void);                   // Move the window on and classify
+unsigned char trafficClassify(void);      // Mode the window shows now
+unsigned char trafficPark(void);          // Floor an idle car parks at, 0: stay
+
+// Telemetry over SCI (see the frame description above SCI_Init)
+#define SCI_BAUD_DIV 26                   // 4MHz E clock / (16 * 26) = 9600 baud
+#define TELE_SIZE    64                   // Transmit ring size, power of 2
+#define TELE_MASK    (TELE_SIZE - 1)
+#define TELE_MAX     17                   // Longest record, without sync, time and check
+#define TELE_SYNC    0xA5                 // Start of every frame
+
+#define TELE_STATE   0x10                 // Record types (high nibble)
+#define TELE_SENSOR  0x20
+#define TELE_KEY     0x30
+#define TELE_DROP    0x40
+#define TELE_SERVICE 0x50
+#define TELE_FAULT   0x60
+#define TELE_MODE    0x70
+#define TELE_LOAD    0x80
+#define TELE_AGE     0x90
+
+#define TELE_F_STATE 0x01                 // STATE record field bits (low nibble)
+#define TELE_F_DIR   0x02
+#define TELE_F_CALLS 0x04
+#define TELE_F_DUTY  0x08
+#define TELE_F_ALL   0x0F
+
+void SCI_Init(void);                      // SCI initialization
+void interrupt 20 SCIHan(void);           // SCI transmit handler
+unsigned char teleSend(unsigned char *rec, unsigned char n);
+unsigned char teleEvent(unsigned char type, unsigned char data);
+void teleService(unsigned char call, unsigned int age);
+void teleState(void);                     // Send the state fields that changed
+void teleLoad(void);                      // Send handler load once a window
+void teleAge(void);                       // Send the call age histogram now and then
+
+unsigned char teleBuf[TELE_SIZE];         // Transmit ring
+unsigned volatile char teleHead = 0;      // Written by the record producers
+unsigned volatile char teleTail = 0;      // Written by SCIHan only
+unsigned volatile char teleDrops = 0;     // Records lost to a full ring
+unsigned volatile char teleBusy = 0;      // IRQ side is inside teleSend
+unsigned int teleLast = 0;                // Tick of the last record sent
+unsigned char teleCount = 0;              // STATE records sent, for keyframes
+unsigned char teleSentState = 0;          // Last STATE fields sent
+unsigned char teleSentDir = 0;
+unsigned char teleSentCalls = 0;
+unsigned char teleSentDuty = 0;
+unsigned char teleSensor = 0;             // Last sensor value sent
+unsigned volatile char teleKey = 0;       // Last keypad code, written by XIRQ
+unsigned volatile char teleKeySeq = 0;    // Bumped by XIRQ on every key
+unsigned char teleKeySent = 0;            // Last teleKeySeq sent
+
+// Handler load. Each handler counts its entries and adds up the TCNT
+// counts (4us) it ran for, nested handlers included. Every counter only
+// goes up, and TickHan sends the change since the last LOAD record, so
+// nothing is reset under a handler that may preempt it. The window is
+// shorter than a TCNT wrap. IRQHan can run for seconds, so TickHan also
+// books its time so far on every tick: loadBusy[LOAD_IRQ] has two
+// writers, and IRQHan only makes its own add with interrupts masked.
+// Every other counter has one writer.
+#define LOAD_TICKS    20                  // LOAD window: 200ms, a TCNT wrap is 262ms
+#define LOAD_IRQ      0                   // Handler index into loadCount/loadBusy
+#define LOAD_XIRQ     1
+#define LOAD_TICK     2
+#define LOAD_SCI      3
+#define LOAD_HANDLERS 4
+
+unsigned volatile int loadCount[LOAD_HANDLERS];  // Entries, wraps
+unsigned volatile int loadBusy[LOAD_HANDLERS];   // TCNT counts spent, wraps
+unsigned int loadSentCount[LOAD_HANDLERS];       // Counters at the last LOAD record
+unsigned int loadSentBusy[LOAD_HANDLERS];
+unsigned int loadStart = 0;               // Tick of the last LOAD record
+unsigned int loadIrqFrom = 0;             // TCNT the running IRQHan is booked from
+unsigned volatile char loadIrqRun = 0;    // IRQHan is running
+
+// Travel watchdog. While the car moves, TickHan times the segment to the
+// next sensor. A stall runs a bounded recovery: pause, creep on, creep
+// back, then give up with the motor off. Past a terminal floor there is
+// nothing to creep on to, so the car only creeps back, and if it finds
+// another floor the terminal one is taken out of service, as the next
+// run there would overrun it again. Any sensor ends recovery and the FSM
+// carries on from that floor. A floor whose sensor is missed
+// WD_MISS_LIMIT times in a row is taken out of service too. The calls
+// for a floor out of service are dropped, so the car stops setting off
+// for a floor it cannot find. Its sensor firing again puts it back.
+#define WD_UP_TICKS    300                // Expected sensor to sensor time going up (3s)
+#define WD_DOWN_TICKS  300                // Same going down
+#define WD_PAUSE_TICKS 50                 // Motor off before creeping
+#define WD_CREEP_TICKS 200                // Creep on this long
+#define WD_BACK_TICKS  600                // Creep back this long, over a segment at creep duty
+#define WD_CREEP_DUTY  150                // Reduced duty for creeping
+#define WD_MISS_LIMIT  2                  // Misses in a row that take a floor out
+
+#define WD_IDLE  0                        // Parked, or IRQ side owns the motor
+#define WD_RUN   1                        // Segment timer armed
+#define WD_PAUSE 2                        // Stalled, motor off
+#define WD_CREEP 3                        // Creeping on in the travel direction
+#define WD_BACK  4                        // Creeping back the other way
+#define WD_FAULT 5                        // Recovery failed, motor off
+
+#define WD_STALL  1                       // FAULT record codes
+#define WD_MISSED 2
+#define WD_RESYNC 3
+#define WD_GAVEUP 4
+#define WD_BADREAD 5                      // Sensor IRQ with none or more than one lit
+#define WD_OUT     5                      // WD_OUT + n: floor n taken out of service
+
+unsigned volatile char wdState = WD_IDLE;
+unsigned int wdStart = 0;                 // Tick the current watchdog step began
+unsigned int wdLimit = 0;                 // Ticks allowed for the current segment
+unsigned char wdDir = 0;                  // Direction when the segment was armed
+unsigned char wdFrom = 0;                 // Floor the segment started from
+unsigned volatile char wdReport = 0;      // Fault code for TickHan to send
+unsigned int wdStalls = 0;                // Fault counters
+unsigned int wdMissed = 0;
+unsigned char wdMisses[4];                // Misses in a row of each floor's sensor
+unsigned char wdOut = 0;                  // Floors out of service, bit n: floor n, IRQ side only
+
 void main(void) {
 
   /*Initizaling*/
   Init();
   LCDInit();
   Timer_Init();
+  SCI_Init();
   LCDClear();
   PWM_Init();
   PWM_Duty(225);
@@ -79,7 +283,9 @@ void main(void) {
   IRQ_Init();
  
  
-  for(;;) {}
+  for(;;) {
+    LCDRefresh();       //Push changed LCD cells
+  }
 }
 
 //***********************************************************
@@ -108,9 +314,63 @@ PWMDTY5 = duty;                   // 0 to 250
 // Timer Intialization for delay
 //**********************************************************
 void Timer_Init(void){
-TIOS = 0x20;        //select TC5 
+TIOS = 0x60;        //select TC5 (delay) and TC6 (tick)
 TSCR1 = 0X80;       //enable timer  
 TSCR2 =0x04;        //set the prescale bits
+TC6 = TCNT + TICK_PERIOD;  //first tick
+TFLG1 = 0x40;       //clear TC6 flag
+TIE = 0x40;         //arm TC6 interrupt
+}
+
+//*********************************************************
+// System tick: TC6 fires every 10ms. Advances the tick
+// count, runs the travel watchdog, times how long the
+// car has stood idle, runs the traffic mode classifier
+// and sends the telemetry records that are
+// latched by other handlers (keypad codes from XIRQ,
+// watchdog faults, drop counts), the handler load and
+// the call age histogram.
+//*********************************************************
+void interrupt 14 TickHan(void){
+unsigned int entry = TCNT;
+unsigned int now;
+unsigned char drops;
+
+TC6 = TC6 + TICK_PERIOD;    //schedule the next tick
+TFLG1 = 0x40;               //clear flag
+ticks++;
+loadCount[LOAD_TICK]++;
+if(loadIrqRun){             //nested in IRQHan: book its time so far
+  now = TCNT;
+  loadBusy[LOAD_IRQ] += now - loadIrqFrom;
+  loadIrqFrom = now;
+}
+wdTick();
+if(direction == 0 && wdState == WD_IDLE && callMask() == 0){
+  if(parkIdle < PARK_TICKS)   //stood with no calls, pending or boxed
+    parkIdle++;
+} else
+  parkIdle = 0;
+
+if(!teleBusy){              //else nested in an IRQ side record, send next tick
+  if(wdReport != 0){
+    if(teleEvent(TELE_FAULT, wdReport))
+      wdReport = 0;
+  }
+  if(teleKeySeq != teleKeySent){
+    teleKeySent = teleKeySeq;
+    teleEvent(TELE_KEY, teleKey);
+  }
+  trafficTick();
+  if(teleDrops != 0){
+    drops = teleDrops;
+    if(teleEvent(TELE_DROP, drops))
+      teleDrops -= drops;
+  }
+  teleLoad();
+  teleAge();
+}
+loadBusy[LOAD_TICK] += TCNT - entry;
 }
 
 //*********************************************************
@@ -148,35 +408,47 @@ for(i =0 ; i< 25; i++){
 //********************************************************
 
 void motorController(void){
+unsigned char due;
+unsigned char park = trafficPark();
+
+wdSensor();
+callMerge();
 
 //Switch based on IR sensor: name "button" a misnomer
 
 switch(button){
 
   case 1: if(button == currentstate){
-            //reset current level vars
-            level1 = 0;
-            up1 = 0;
-         
             //delay
             motorStop();
+            callMerge();
          
+            //reset current level vars, after the delay so a
+            //press here while the car stood is served by it
+            callServe(CALL_LEVEL1);
+            callServe(CALL_UP1);
          
          
             //condition for level2
-            if((level2 == 1) || (up2 == 1)){
+            if(PENDING(CALL_LEVEL2|CALL_UP2)){
               nextstate = 2;
               direction = 1;
             }
             //condition for level3
-            else if ((level3 == 1) || (down3 == 1)){
+            else if (PENDING(CALL_LEVEL3|CALL_DOWN3)){
               nextstate = 3;
               direction = 1;
-            }else if (down2 == 1){
+            }else if (PENDING(CALL_DOWN2)){
               nextstate = 2;
               direction = 1;
           
             }
+            //nothing pressed for PARK_TICKS: park where the
+            //traffic mode wants the car
+            else if(parkIdle >= PARK_TICKS && park > 1){
+              nextstate = park;
+              direction = 1;
+            }
             //condtion if nothing is pressed
             //should state in same level
             else{
@@ -187,58 +459,94 @@ switch(button){
           }
           break;
  
-  case 2:  if(button == currentstate || level2 == 1 || up2 == 1 || down2 == 1){
-            //reset current level vars
-            level2 = 0;
-         
+  //stop for a hall call here only if the car is not already
+  //going the other way: it would not take it on board
+  case 2:  if(button == currentstate || PENDING(CALL_LEVEL2) || (PENDING(CALL_UP2) && direction != 2)
+              || (PENDING(CALL_DOWN2) && direction != 1)){
             //delay
             motorStop();
+            callMerge();
          
-            //condition for level1
-            if(((level1 == 1) || (up1 == 1)) && !((down3 == 1) && (direction == 1))){
+            //reset current level vars, after the delay so a
+            //press here while the car stood is served by it
+            callServe(CALL_LEVEL2);
+         
+            due = callDue();
+            //a call past its deadline goes before anything else
+            if(due == 1){
              nextstate = 1;
              direction = 2;
-             down2 = 0; // reset
+             callServe(CALL_DOWN2);
             }
-            //condition for level2
-            else if (((level3 == 1) || (down3 ==1)) && !((up1 == 1) && (direction == 2))){
+            else if(due == 3){
+              nextstate = 3;
+              direction = 1;
+              callServe(CALL_UP2);
+            }
+            //condition for level1, unless the car came up and
+            //there is a call above or an up call here, or the
+            //car is idle and the calls above are older
+            else if(PENDING(CALL_LEVEL1|CALL_UP1) && !(PENDING(CALL_LEVEL3|CALL_DOWN3|CALL_UP2) && (direction == 1))
+                    && !((direction == 0) && (callAge(CALL_LEVEL3|CALL_DOWN3) > callAge(CALL_LEVEL1|CALL_UP1)))){
+             nextstate = 1;
+             direction = 2;
+             callServe(CALL_DOWN2);
+            }
+            //condition for level3, unless the car came down and
+            //there is a call below or a down call here
+            else if (PENDING(CALL_LEVEL3|CALL_DOWN3) && !(PENDING(CALL_LEVEL1|CALL_UP1|CALL_DOWN2) && (direction == 2))){
               nextstate = 3;
               direction = 1;
-              up2 = 0; // reset
+              callServe(CALL_UP2);
+            }
+            //nothing pressed for PARK_TICKS: park where the
+            //traffic mode wants the car
+            else if(parkIdle >= PARK_TICKS && (park == 1 || park == 3)){
+              nextstate = park;
+              direction = (park == 1) ? 2 : 1;
             }
             //condtion if nothing is pressed
-            //should state in same level
+            //should state in same level. That is level 2 also
+            //when the car only stopped here on its way elsewhere
              else {
-              nextstate = currentstate;
+              nextstate = 2;
               direction = 0;
-              up2 = 0;
-              down2 = 0;
+              callServe(CALL_UP2);
+              callServe(CALL_DOWN2);
             }
            }
            break;
  
   case 3:  if(button == currentstate){
-            //reset current level vars
-            level3 = 0;
-            down3 = 0;
-         
             //delay
             motorStop();
+            callMerge();
+         
+            //reset current level vars, after the delay so a
+            //press here while the car stood is served by it
+            callServe(CALL_LEVEL3);
+            callServe(CALL_DOWN3);
          
             //condition for level2
-            if((level2 == 1) || (down2 == 1)){
+            if(PENDING(CALL_LEVEL2|CALL_DOWN2)){
              nextstate = 2;
              direction = 2;
             }
             //condition for level1
-            else if ((level1 == 1 ) || (up1 == 1)){
+            else if (PENDING(CALL_LEVEL1|CALL_UP1)){
               nextstate = 1;
               direction = 2;
-            } else if (up2  == 1){
+            } else if (PENDING(CALL_UP2)){
              nextstate = 2;
              direction = 2;
           
             }
+            //nothing pressed for PARK_TICKS: park where the
+            //traffic mode wants the car
+            else if(parkIdle >= PARK_TICKS && park != 0 && park < 3){
+              nextstate = park;
+              direction = 2;
+            }
             //condtion if nothing is pressed
             //should state in same level
             else {
@@ -277,6 +585,352 @@ switch(button){
    if(nextstate != 0)
    currentstate = nextstate;  
 
+   if(direction != 0)
+   wdArm();
+
+   teleState();
+}
+
+//********************************************************
+// Traffic mode, every tick. Once a bucket period is over
+// the oldest bucket is cleared and becomes the one XIRQ
+// counts into, then the window is classified. The work
+// per call press is only the count in callPress.
+//********************************************************
+void trafficTick(void){
+unsigned char next;
+unsigned char i;
+unsigned char seen;
+
+if((unsigned int)(ticks - trafficStart) < TRAFFIC_BUCKET_TICKS)
+  return;
+trafficStart += TRAFFIC_BUCKET_TICKS;
+
+next = (trafficNow + 1) & (TRAFFIC_BUCKETS - 1);
+for(i = 0; i < CALL_COUNT; i++)
+  trafficCount[next][i] = 0;
+trafficNow = next;                       //cleared before XIRQ can count into it
+
+seen = trafficClassify();
+if(seen == trafficSeen && seen != trafficMode){
+  trafficMode = seen;
+  teleEvent(TELE_MODE, seen);
+}
+trafficSeen = seen;
+}
+
+//********************************************************
+// Classify the calls in the window. Hall calls tell the
+// direction people travel: up from the lobby in the
+// morning, down from the upper levels in the evening.
+//********************************************************
+unsigned char trafficClassify(void){
+unsigned int total[CALL_COUNT];
+unsigned int all = 0;
+unsigned int hall;
+unsigned int up;
+unsigned int down;
+unsigned char b;
+unsigned char i;
+
+for(i = 0; i < CALL_COUNT; i++)
+  total[i] = 0;
+for(b = 0; b < TRAFFIC_BUCKETS; b++){
+  for(i = 0; i < CALL_COUNT; i++)
+    total[i] += trafficCount[b][i];
+}
+for(i = 0; i < CALL_COUNT; i++)
+  all += total[i];
+
+//idle has different thresholds to enter and leave
+if(all < TRAFFIC_IDLE_ENTER || (trafficMode == MODE_IDLE && all < TRAFFIC_IDLE_LEAVE))
+  return MODE_IDLE;
+
+up = total[callIndex(CALL_UP1)];
+down = total[callIndex(CALL_DOWN2)] + total[callIndex(CALL_DOWN3)];
+hall = up + down + total[callIndex(CALL_UP2)];
+
+//a peak starts at three quarters of the hall calls one
+//way and holds while it is still half of them
+if(up >= TRAFFIC_PEAK_MIN && 4 * up >= ((trafficMode == MODE_UPPEAK) ? 2 : 3) * hall)
+  return MODE_UPPEAK;
+if(down >= TRAFFIC_PEAK_MIN && 4 * down >= ((trafficMode == MODE_DOWNPEAK) ? 2 : 3) * hall)
+  return MODE_DOWNPEAK;
+return MODE_INTERFLOOR;
+}
+
+//********************************************************
+// Floor the active traffic mode parks an idle car at, not
+// one that is out of service
+//********************************************************
+unsigned char trafficPark(void){
+unsigned char floor;
+
+switch(trafficMode){
+  case MODE_UPPEAK:     floor = 1; break;
+  case MODE_DOWNPEAK:   floor = 3; break;
+  case MODE_INTERFLOOR: floor = 2; break;
+  default:              floor = 0; break;
+}
+if(wdOut & (1 << floor))
+  return 0;
+return floor;
+}
+
+//********************************************************
+// Watchdog: the motor is running, time the segment from
+// this sensor to the next one. The limit is twice the
+// segment. If the next floor is not a terminal one and its
+// sensor is dead, the sensor after it fires two segments
+// out, so one more segment is allowed for that; the missed
+// sensor is then reported instead of a stall. wdState is
+// set last, so a nested tick never sees a half armed
+// segment.
+//********************************************************
+void wdArm(void){
+unsigned int segment = (direction == 1) ? WD_UP_TICKS : WD_DOWN_TICKS;
+unsigned char next = (direction == 1) ? button + 1 : button - 1;
+
+wdFrom = (unsigned char)button;
+wdDir = (unsigned char)direction;
+wdLimit = 2 * segment;
+if(next > 1 && next < 3)
+  wdLimit += segment;
+wdStart = ticks;
+wdState = WD_RUN;
+}
+
+//********************************************************
+// Watchdog: a sensor fired. If it is not the sensor the
+// car left from or the next one along, a sensor in between
+// was passed without firing. If the car was recovering,
+// it has found a floor; if that is not the terminal floor
+// it was heading for, the car overran that one. Either way
+// currentstate is set to where the car really is, so the
+// FSM stops and decides from there. The IRQ side owns the
+// motor again.
+//********************************************************
+void wdSensor(void){
+unsigned char next;
+
+if(button < 1 || button > 3)
+  return;
+
+wdMisses[button] = 0;                    //this floor can be found
+wdOut &= ~(1 << button);
+
+if(wdState == WD_RUN){
+  next = (wdDir == 1) ? wdFrom + 1 : wdFrom - 1;
+  if(button != wdFrom && button != next){
+    wdMissed++;
+    teleEvent(TELE_FAULT, WD_MISSED);
+    currentstate = button;
+    if(++wdMisses[next] >= WD_MISS_LIMIT && !(wdOut & (1 << next))){
+      wdOut |= 1 << next;
+      teleEvent(TELE_FAULT, WD_OUT + next);
+    }
+  }
+} else if(wdState != WD_IDLE){
+  teleEvent(TELE_FAULT, WD_RESYNC);
+  currentstate = button;
+  next = (wdDir == 1) ? wdFrom + 1 : wdFrom - 1;
+  if((next == 1 || next == 3) && button != next && !(wdOut & (1 << next))){
+    wdOut |= 1 << next;
+    teleEvent(TELE_FAULT, WD_OUT + next);
+  }
+}
+wdState = WD_IDLE;
+}
+
+//********************************************************
+// Watchdog, every tick: stall detection and the recovery
+// sequence. Each step is bounded, the last one stops the
+// motor and waits for a sensor. If the segment ends at a
+// terminal floor the car may already be past it, so it
+// creeps straight back towards the floor it came from.
+//********************************************************
+void wdTick(void){
+unsigned int t = ticks - wdStart;
+unsigned char next;
+
+switch(wdState){
+  case WD_RUN:   if(t > wdLimit){                  //no sensor in time
+                   PTAD = (PTAD & ~(PTAD_PTAD7_MASK|PTAD_PTAD6_MASK));
+                   wdStalls++;
+                   wdReport = WD_STALL;
+                   wdStart = ticks;
+                   wdState = WD_PAUSE;
+                 }
+                 break;
+  case WD_PAUSE: if(t > WD_PAUSE_TICKS){
+                   next = (wdDir == 1) ? wdFrom + 1 : wdFrom - 1;
+                   if(next == 1 || next == 3){     //nothing beyond: creep back
+                     motorCreep((wdDir == 1) ? 2 : 1);
+                     wdState = WD_BACK;
+                   } else {                        //creep on
+                     motorCreep(wdDir);
+                     wdState = WD_CREEP;
+                   }
+                   wdStart = ticks;
+                 }
+                 break;
+  case WD_CREEP: if(t > WD_CREEP_TICKS){           //creep back past the start
+                   motorCreep((wdDir == 1) ? 2 : 1);
+                   wdStart = ticks;
+                   wdState = WD_BACK;
+                 }
+                 break;
+  case WD_BACK:  if(t > WD_BACK_TICKS){            //give up
+                   PTAD = (PTAD & ~(PTAD_PTAD7_MASK|PTAD_PTAD6_MASK));
+                   wdReport = WD_GAVEUP;
+                   wdState = WD_FAULT;
+                 }
+                 break;
+  default:       break;
+}
+}
+
+//********************************************************
+// Run the motor at creep speed. 1: UP, 2: DOWN
+//********************************************************
+void motorCreep(unsigned char dir){
+PWM_Duty(WD_CREEP_DUTY);
+if(dir == 1)
+  PTAD = (PTAD & ~(PTAD_PTAD6_MASK))|(PTAD_PTAD7_MASK);
+else
+  PTAD = (PTAD & ~(PTAD_PTAD7_MASK))|(PTAD_PTAD6_MASK);
+}
+
+//********************************************************
+// Pack the seven call flags into the CALL_ bits
+//********************************************************
+unsigned char callMask(void){
+unsigned char mask = pendingCalls;
+unsigned char i;
+
+for(i = 0; i < CALL_COUNT; i++){
+  if(callBox[i] != 0)
+    mask |= 1 << i;
+}
+return mask;
+}
+
+//********************************************************
+// Index of a call bit into callBox/callTime/callFloor
+//********************************************************
+unsigned char callIndex(unsigned char call){
+unsigned char i = 0;
+
+while(call > 1){
+  call >>= 1;
+  i++;
+}
+return i;
+}
+
+//********************************************************
+// Register a call from XIRQ: only sets its box entry. The
+// stamp is written before the box and only while the box
+// is empty, so pressing again does not make a call younger.
+//********************************************************
+void callPress(unsigned char call){
+unsigned char i = callIndex(call);
+unsigned char *count = &trafficCount[trafficNow][i];
+
+if(callBox[i] == 0)
+  callStamp[i] = ticks;
+callBox[i] = 1;
+
+if(*count != 0xFF)                       //traffic statistics
+  (*count)++;
+}
+
+//********************************************************
+// Move boxed calls into pendingCalls (IRQ side). If XIRQ
+// presses the same call between the test and the clear,
+// that press is already part of the call being merged.
+// A call that is already pending keeps its older time.
+// Calls for a floor out of service are dropped.
+//********************************************************
+void callMerge(void){
+unsigned char i;
+
+for(i = 0; i < CALL_COUNT; i++){
+  if(wdOut & (1 << callFloor[i])){
+    callBox[i] = 0;
+    pendingCalls &= ~(1 << i);
+  } else if(callBox[i] != 0){
+    if(!(pendingCalls & (1 << i))){
+      callTime[i] = callStamp[i];
+      pendingCalls |= 1 << i;
+    }
+    callBox[i] = 0;
+  }
+}
+}
+
+//********************************************************
+// Clear a call. If it was pending, its age goes into the
+// histogram and out on the telemetry stream.
+//********************************************************
+void callServe(unsigned char call){
+unsigned char i = callIndex(call);
+unsigned char b = 0;
+unsigned int age;
+
+if(pendingCalls & call){
+  age = ticks - callTime[i];
+  teleService(call, age);
+  age >>= 6;                            //bucket 0 is under 64 ticks
+  while(age != 0 && b < AGE_BUCKETS - 1){
+    age >>= 1;
+    b++;
+  }
+  if(callAgeHist[b] != 0xFFFF)
+    callAgeHist[b]++;
+}
+pendingCalls &= ~call;
+}
+
+//********************************************************
+// Age in ticks of the oldest pending call among calls,
+// 0 if none of them is pending
+//********************************************************
+unsigned int callAge(unsigned char calls){
+unsigned int oldest = 0;
+unsigned int age;
+unsigned char i;
+
+for(i = 0; i < CALL_COUNT; i++){
+  if(calls & pendingCalls & (1 << i)){
+    age = ticks - callTime[i];
+    if(age > oldest)
+      oldest = age;
+  }
+}
+return oldest;
+}
+
+//********************************************************
+// Floor of the oldest call that has waited CALL_DEADLINE
+// or longer, 0 if no call is that old
+//********************************************************
+unsigned char callDue(void){
+unsigned int oldest = CALL_DEADLINE - 1;
+unsigned int age;
+unsigned char floor = 0;
+unsigned char i;
+
+for(i = 0; i < CALL_COUNT; i++){
+  if(pendingCalls & (1 << i)){
+    age = ticks - callTime[i];
+    if(age > oldest){
+      oldest = age;
+      floor = callFloor[i];
+    }
+  }
+}
+return floor;
 }
 
 //*******************************************************
@@ -286,49 +940,59 @@ switch(button){
 // The control will be mostly in this ISR since the elevator
 // always will stop in one of the levels. Hence the motor
 // controller called from here. 
+// Calls come in through the callBox mailbox, so nothing
+// here needs interrupts masked. Only IRQ itself is held
+// off, and the tick and SCI handlers may run meanwhile.
+// A read that does not light exactly one sensor leaves
+// the FSM and the watchdog alone: button would still be
+// the last level, and acting on it would stop or re-arm
+// the car between floors.
 //*******************************************************
 void interrupt 6 IRQHan(void){
-asm sei;
-scanIRSensor();
-motorController();
-asm cli;
+INTCR = 0x00;        // IRQ is level sensitive: hold it off, not the others
+loadCount[LOAD_IRQ]++;
+loadIrqFrom = TCNT;  // TickHan books the time from here while it runs
+loadIrqRun = 1;
+EnableInterrupts;    // Tick and SCI keep running through the stop delay
+if(scanIRSensor())
+  motorController();
+DisableInterrupts;
+loadIrqRun = 0;
+loadBusy[LOAD_IRQ] += TCNT - loadIrqFrom;
+INTCR = 0x40;
 }
 
 //*******************************************************
-// Scan the IR sensor to detect the level
+// Scan the IR sensor to detect the level. Returns 1 and
+// sets button if exactly one sensor is lit, else reports
+// the bad read once and returns 0.
 //*******************************************************
-void scanIRSensor(void){
-  int value;
+unsigned char scanIRSensor(void){
+  unsigned char value;
+  unsigned char edge;
  
   value = PTAD & 0x1C;
+  edge = (value != teleSensor);
+  if(edge){                       // Only edges, the IRQ repeats while parked
+    if(teleEvent(TELE_SENSOR, value))
+      teleSensor = value;
+  }
+   LCDSetCursor(LCD_AT_IR);      // Used for debugging
    switch(value){
     case 16: button = 3;         // Assign the level
-               LCDString("IR3"); // Used for debugging
-               break;
+               LCDString("IR3      ");
+               return 1;
     case 8: button = 2;          // Assign the level
-               LCDString("IR2"); // Used for debugging
-               break;
+               LCDString("IR2      ");
+               return 1;
     case 4: button = 1;          // Assign the level
-               LCDString("IR1"); // Used for debugging
-               break;
-    case 28:  LCDClear();        // Used to debugging  
-              LCDInt(28);        // if IR sensors mismatch
-              LCDString("IRErr");
-              break;
-    case 24:  LCDClear();        // Used to debugging  
-              LCDInt(24);        // if IR sensors mismatch
-              LCDString("IRErr");
-              break;
-    case 20:  LCDClear();        // Used to debugging  
-              LCDInt(20);        // if IR sensors mismatch
-              LCDString("IRErr");
-              break;
-    case 12:  LCDClear();        // Used to debugging  
-              LCDInt(12);        // if IR sensors mismatch
-              LCDString("IRErr");
-              break;
-    default:  break;             //Shouldnt happen
-                      
+               LCDString("IR1      ");
+               return 1;
+    default:  LCDString("IRErr ");  // if IR sensors mismatch, or
+              LCDDecimal(value);    // none is lit (noise on IRQ)
+              if(edge)
+                teleEvent(TELE_FAULT, WD_BADREAD);
+              return 0;
   }
 }
 
@@ -345,10 +1009,18 @@ asm cli
 // XIRQ Handler 
 //*************************************************************
 void interrupt 5 XIRQHan(void){
-INTCR =0x00;        
-LCDString("XIRQ"); // Debug statement
+unsigned int entry = TCNT;
+unsigned char intcr = INTCR;  // IRQ may already be held off by IRQHan
+unsigned char cursor = lcdCursor;
+INTCR =0x00;
+loadCount[LOAD_XIRQ]++;
+LCDSetCursor(LCD_AT_XIRQ);    // Debug statement
+LCDString("XIRQ ");
+LCDInt(loadCount[LOAD_XIRQ]);
+lcdCursor = cursor;           // IRQHan may be writing at the cursor
 scan();            // scan Keypad
-INTCR =0x40;
+INTCR =intcr;
+loadBusy[LOAD_XIRQ] += TCNT - entry;
 }
 
 //*************************************************************
@@ -380,6 +1052,10 @@ void scan(){
 void scanInput(int value) 
 {
 value = value & 0x7F;  // Take 0 : 6 only, 7th bit discarded
+if(value & 0x70){      // A column is set: latch the key for TickHan to send
+  teleKey = value;
+  teleKeySeq++;
+}
 switch(value){
 
   //1
@@ -392,31 +1068,31 @@ switch(value){
   case 65: break;                          // Ignored
 
   //4 :up1
-  case 18: up1 = 1;                        // Level 1 (outside elevator) button pressed to go up
+  case 18: callPress(CALL_UP1);            // Level 1 (outside elevator) button pressed to go up
            break;
 
   //5 :up2
-  case 34: up2 = 1;                        // Level 2 (outside elevator) button pressed to go up
+  case 34: callPress(CALL_UP2);            // Level 2 (outside elevator) button pressed to go up
            break;
 
   //6 :down2
-  case 66: down2 = 1;                      // Level 2 (outside elevator) button pressed to go down
+  case 66: callPress(CALL_DOWN2);          // Level 2 (outside elevator) button pressed to go down
            break;
 
   //7 : level 1
-  case 20: level1 = 1;                     // Level 1 (inside elevator) button pressed to go to level 1
+  case 20: callPress(CALL_LEVEL1);         // Level 1 (inside elevator) button pressed to go to level 1
            break;
 
   //8  : level 2			   
-  case 36: level2 = 1;                     // Level 2 (inside elevator) button pressed to go to level 2
+  case 36: callPress(CALL_LEVEL2);         // Level 2 (inside elevator) button pressed to go to level 2
            break;
 
   //9  : level 3                           
-  case 68: level3 = 1;                     // Level 3 (inside elevator) button pressed to go to level 3
+  case 68: callPress(CALL_LEVEL3);         // Level 3 (inside elevator) button pressed to go to level 3
            break;
 
   //0   : down 3
-  case 40: down3 = 1;                      // Level 3 (outside elevator) button pressed to go down
+  case 40: callPress(CALL_DOWN3);          // Level 3 (outside elevator) button pressed to go down
            break;
 
   //default
@@ -460,6 +1136,237 @@ int ReadInput(void)
 
 }
 
+//****************************************************************************
+// Telemetry: binary records sent over SCI at 9600 baud, interrupt driven.
+// Every frame is
+//   0xA5 | type+fields | dt | payload | check
+// type+fields: record type in the high nibble, field bits in the low one.
+// dt: ticks (10ms) since the previous frame. 0xFF is followed by the
+//     absolute 16 bit tick count (high byte first) when dt would not fit.
+// check: XOR of every byte after 0xA5, so a decoder can resync on 0xA5.
+// Records:
+//   STATE  only the fields named in the low nibble, in this order:
+//          state, direction, call bits, PWM duty. Every 16th STATE
+//          record is a keyframe carrying all four fields.
+//   SENSOR raw IR sensor bits (PTAD & 0x1C), sent on change
+//   KEY    raw keypad code from scanInput
+//   DROP   number of records lost because the ring was full
+//   SERVICE call bit, then its age in ticks (16 bit) when it was served
+//   FAULT  watchdog code: 1 stall, 2 missed sensor, 3 floor found while
+//          recovering, 4 recovery gave up, 5 sensor IRQ with none or
+//          more than one sensor lit, 6 to 8 floor 1 to 3 taken out of
+//          service
+//   MODE   new traffic mode: 0 idle, 1 up-peak, 2 down-peak, 3 interfloor
+//   LOAD   for IRQ, XIRQ, tick and SCI in that order: entries, then TCNT
+//          counts (4us) busy, both 16 bit, since the last LOAD record.
+//          The window ends at the record's own time.
+//   AGE    callAgeHist, AGE_BUCKETS counts of 16 bit: calls served since
+//          reset by their age, bucket n under 64 << n ticks, the last
+//          one open. Sent every AGE_TICKS; a lost one loses nothing.
+// A record costs a bounded copy of at most TELE_MAX + 5 bytes; when the
+// ring is full it is dropped and counted instead of waiting on the SCI.
+// Producers are IRQHan and TickHan. TickHan can nest inside IRQHan, so
+// it backs off while teleBusy is set. XIRQ only latches the key code,
+// TickHan sends it.
+//****************************************************************************
+void SCI_Init(void){
+SCIBDH = 0x00;
+SCIBDL = SCI_BAUD_DIV;      //9600 baud
+SCICR1 = 0x00;              //8N1
+SCICR2 = SCICR2_TE_MASK;    //transmitter on, TIE set when there is data
+}
+
+//****************************************************************************
+// SCI Handler: sends one byte per TDRE, stops itself when the ring is empty
+//****************************************************************************
+void interrupt 20 SCIHan(void){
+unsigned int entry = TCNT;
+
+loadCount[LOAD_SCI]++;
+if(teleTail != teleHead){
+  if(SCISR1 & SCISR1_TDRE_MASK){           //Reading SCISR1 arms the TDRE clear
+    SCIDRL = teleBuf[teleTail];
+    teleTail = (teleTail + 1) & TELE_MASK;
+  }
+} else {
+  SCICR2 &= ~SCICR2_TIE_MASK;              //Nothing left to send
+}
+loadBusy[LOAD_SCI] += TCNT - entry;
+}
+
+//****************************************************************************
+// Frame a record into the ring: rec[0] is the type and fields byte, the
+// other n - 1 bytes are the payload. The time delta is added here. Returns
+// 0 and counts a drop if the ring has no room.
+//****************************************************************************
+unsigned char teleSend(unsigned char *rec, unsigned char n){
+unsigned char stamp[3];
+unsigned char len;
+unsigned char head;
+unsigned char chk;
+unsigned char i;
+unsigned int now;
+unsigned int dt;
+
+teleBusy = 1;
+now = ticks;
+dt = now - teleLast;
+if(dt < 0xFF){
+  stamp[0] = (unsigned char)dt;
+  len = 1;
+} else {
+  stamp[0] = 0xFF;
+  stamp[1] = (unsigned char)(now >> 8);
+  stamp[2] = (unsigned char)now;
+  len = 3;
+}
+
+if((unsigned char)((teleTail - teleHead - 1) & TELE_MASK) < n + len + 2){
+  if(teleDrops != 0xFF)
+    teleDrops++;
+  teleBusy = 0;
+  return 0;
+}
+head = teleHead;
+teleBuf[head] = TELE_SYNC;
+head = (head + 1) & TELE_MASK;
+chk = rec[0];
+teleBuf[head] = rec[0];
+head = (head + 1) & TELE_MASK;
+for(i = 0; i < len; i++){
+  chk ^= stamp[i];
+  teleBuf[head] = stamp[i];
+  head = (head + 1) & TELE_MASK;
+}
+for(i = 1; i < n; i++){
+  chk ^= rec[i];
+  teleBuf[head] = rec[i];
+  head = (head + 1) & TELE_MASK;
+}
+teleBuf[head] = chk;
+teleHead = (head + 1) & TELE_MASK;       //Publish the whole frame at once
+teleLast = now;
+SCICR2 |= SCICR2_TIE_MASK;               //Kick the transmitter
+teleBusy = 0;
+return 1;
+}
+
+//****************************************************************************
+// Send a record with a one byte payload
+//****************************************************************************
+unsigned char teleEvent(unsigned char type, unsigned char data){
+unsigned char rec[2];
+
+rec[0] = type;
+rec[1] = data;
+return teleSend(rec, 2);
+}
+
+//****************************************************************************
+// Send a SERVICE record: the call bit and its age in ticks
+//****************************************************************************
+void teleService(unsigned char call, unsigned int age){
+unsigned char rec[4];
+
+rec[0] = TELE_SERVICE;
+rec[1] = call;
+rec[2] = (unsigned char)(age >> 8);
+rec[3] = (unsigned char)age;
+teleSend(rec, 4);
+}
+
+//****************************************************************************
+// Send a STATE record with only the fields that changed since the last one
+//****************************************************************************
+void teleState(void){
+unsigned char rec[TELE_MAX];
+unsigned char n;
+unsigned char fields = 0;
+unsigned char calls = callMask();
+unsigned char duty = PWMDTY5;
+
+if((teleCount & 0x0F) == 0) fields = TELE_F_ALL;   //keyframe
+if((unsigned char)currentstate != teleSentState) fields |= TELE_F_STATE;
+if((unsigned char)direction != teleSentDir)      fields |= TELE_F_DIR;
+if(calls != teleSentCalls)                       fields |= TELE_F_CALLS;
+if(duty != teleSentDuty)                         fields |= TELE_F_DUTY;
+if(fields == 0)
+  return;
+
+rec[0] = TELE_STATE | fields;
+n = 1;
+if(fields & TELE_F_STATE) rec[n++] = (unsigned char)currentstate;
+if(fields & TELE_F_DIR)   rec[n++] = (unsigned char)direction;
+if(fields & TELE_F_CALLS) rec[n++] = calls;
+if(fields & TELE_F_DUTY)  rec[n++] = duty;
+
+if(teleSend(rec, n)){
+  teleSentState = (unsigned char)currentstate;
+  teleSentDir = (unsigned char)direction;
+  teleSentCalls = calls;
+  teleSentDuty = duty;
+  teleCount++;
+}
+}
+
+//****************************************************************************
+// Send a LOAD record once LOAD_TICKS have passed since the last one. If the
+// ring is full it is tried again next tick and covers the longer window.
+//****************************************************************************
+void teleLoad(void){
+unsigned char rec[TELE_MAX];
+unsigned int count[LOAD_HANDLERS];
+unsigned int busy[LOAD_HANDLERS];
+unsigned int d;
+unsigned char n = 1;
+unsigned char i;
+
+if((unsigned int)(ticks - loadStart) < LOAD_TICKS)
+  return;
+
+rec[0] = TELE_LOAD;
+for(i = 0; i < LOAD_HANDLERS; i++){
+  count[i] = loadCount[i];
+  busy[i] = loadBusy[i];
+  d = count[i] - loadSentCount[i];
+  rec[n++] = (unsigned char)(d >> 8);
+  rec[n++] = (unsigned char)d;
+  d = busy[i] - loadSentBusy[i];
+  rec[n++] = (unsigned char)(d >> 8);
+  rec[n++] = (unsigned char)d;
+}
+
+if(teleSend(rec, n)){
+  for(i = 0; i < LOAD_HANDLERS; i++){
+    loadSentCount[i] = count[i];
+    loadSentBusy[i] = busy[i];
+  }
+  loadStart = ticks;
+}
+}
+
+//****************************************************************************
+// Send an AGE record once AGE_TICKS have passed since the last one. The
+// counts only go up, so the host takes the latest record as it is.
+//****************************************************************************
+void teleAge(void){
+unsigned char rec[TELE_MAX];
+unsigned char n = 1;
+unsigned char i;
+
+if((unsigned int)(ticks - ageStart) < AGE_TICKS)
+  return;
+
+rec[0] = TELE_AGE;
+for(i = 0; i < AGE_BUCKETS; i++){
+  rec[n++] = (unsigned char)(callAgeHist[i] >> 8);
+  rec[n++] = (unsigned char)callAgeHist[i];
+}
+
+if(teleSend(rec, n))
+  ageStart = ticks;
+}
+
 //****************************************************************************
 // All the code below are for LCD, reused from the previous lab assignment
 //****************************************************************************
@@ -469,6 +1376,8 @@ int ReadInput(void)
 // and requires two writes for each write.
 //****************************************************************************
 void LCDInit() {
+  unsigned char i;
+
   //set up SPI to write to LCD
   SPICR1 = 0x5E;
   //Data Sheet - PG419
@@ -537,23 +1446,78 @@ void LCDInit() {
   LCDWR(0x00);
   LCDWR(0x0F);
 
+  //The display is blank and the cursor home
+  for(i = 0; i < LCD_CELLS; i++) {
+    lcdFrame[i] = ' ';
+    lcdShown[i] = ' ';
+  }
+  lcdCursor = 0;
 }
 
 //******************************************************************************
-//Purpose:  This function clears the data from the LCD screen and returns
-//          the cursor back to home.
+//Purpose:  This function clears the frame buffer and returns the cursor back
+//          to home. Only the cells that were not blank get sent on refresh.
 //******************************************************************************
 void LCDClear() {
- //Clear
-  LCDWR(0x00);
-  LCDWR(0x01);
-  LCDdelay(10);
+  unsigned char i;
 
-  //Return the cursor home
-  LCDWR(0x00);
-  LCDWR(0x02);
-  LCDdelay(10);
+  for(i = 0; i < LCD_CELLS; i++) {
+    lcdFrame[i] = ' ';
+  }
+  lcdCursor = 0;
+  lcdDirty = 1;
+}
+
+//******************************************************************************
+//Purpose:  LCDRefresh sends every cell of lcdFrame that differs from what the
+//          panel shows. The address is only set when the next changed cell is
+//          not where the LCD address counter already points. A handler that
+//          writes a cell behind the scan sets lcdDirty again, so it is picked
+//          up on the next call.
+//******************************************************************************
+void LCDRefresh() {
+  unsigned char i;
+  unsigned char c;
+  unsigned char addr = 0xFF;   //LCD address counter unknown
+
+  if(!lcdDirty)
+    return;
+  lcdDirty = 0;
+
+  for(i = 0; i < LCD_CELLS; i++) {
+    c = lcdFrame[i];
+    if(c != lcdShown[i]) {
+      if(addr != i)
+        LCDGoto(i);
+      LCDData(c);
+      lcdShown[i] = c;
+      //the counter runs on within a line, not into the next one
+      addr = ((i + 1) & (LCD_COLS - 1)) ? i + 1 : 0xFF;
+    }
+  }
+}
+
+//******************************************************************************
+//Purpose:  LCDSetCursor points the frame cursor at a cell, so the next
+//          LCDChar writes there. Nothing is sent to the panel.
+//******************************************************************************
+void LCDSetCursor(unsigned char cell) {
+  lcdCursor = cell & (LCD_CELLS - 1);
+}
+
+//******************************************************************************
+//Purpose:  LCDGoto points the LCD address counter at a frame buffer cell
+//******************************************************************************
+void LCDGoto(unsigned char cell) {
+  unsigned char addr;
+
+  addr = cell & (LCD_COLS - 1);          //column
+  if(cell & LCD_COLS)
+    addr |= 0x40;                        //second line
 
+  //Set DDRAM address
+  LCDWR(0x08 | (addr >> 4));
+  LCDWR(addr & 0x0F);
 }
 
 
@@ -599,30 +1563,36 @@ void spiWR(unsigned char data) {
 //          to the LCDChar function to output the character onto the LCD screen.
 //******************************************************************************
 void LCDString(char *pt){
-  int temp = 0;
-  int j = 0;
   while(*pt) {
     if(*pt == '\n') {
-      for(j = 0; j < (35-temp); j++) {
-        LCDChar(' ');
-      }
-    pt++;
-    temp=0;
+      //start of the next line
+      lcdCursor = (lcdCursor + LCD_COLS) & ~(LCD_COLS - 1) & (LCD_CELLS - 1);
     }
     else {
     LCDChar(*pt);
-    pt++;
-    temp++;
     }
+    pt++;
   }
 }
 
 //******************************************************************************
-//Purpose:  LCDChar sends the proper communication over the SPI to the
+//Purpose:  LCDChar puts a character in the frame buffer at the cursor and
+//          moves the cursor on, wrapping at the end of the display.
+//******************************************************************************
+void LCDChar(unsigned char outchar){
+  unsigned char cell = lcdCursor;
+
+  lcdFrame[cell] = outchar;
+  lcdCursor = (cell + 1) & (LCD_CELLS - 1);
+  lcdDirty = 1;
+}
+
+//******************************************************************************
+//Purpose:  LCDData sends the proper communication over the SPI to the
 //          74HC95 chip.  The chip in turn communicates with the LCD module as
 //          specified in the AN1774 document.
 //******************************************************************************                                                                       
-void LCDChar(unsigned char outchar){
+void LCDData(unsigned char outchar){
 
   // Output the higher four bits.
   spiWR((0x0F&(outchar>>4)) & ~ENABLE_BIT | RS_BIT);    // Place data onto bus
@@ -656,34 +1626,49 @@ void LCDNum(int val)
 
 }
 
+//******************************************************************************
+//Purpose:  Converts val to 5 BCD digits, most significant first, with the
+//          shift-and-add-3 (double dabble) method: no division, and the same
+//          16 passes for every value.
+//******************************************************************************
+void LCDDigits(unsigned int val, unsigned char *digit)
+{
+  unsigned char i;
+  unsigned char j;
+
+  for(j = 0; j < 5; j++)
+    digit[j] = 0;
+
+  for(i = 0; i < 16; i++)
+  {
+    //a digit of 5 or more carries once it is doubled
+    for(j = 0; j < 5; j++)
+    {
+      if(digit[j] >= 5)
+        digit[j] += 3;
+    }
+
+    //shift the digits left one bit, the top bit of val comes in
+    for(j = 0; j < 4; j++)
+      digit[j] = ((digit[j] << 1) | (digit[j + 1] >> 3)) & 0x0F;
+    digit[4] = ((digit[4] << 1) | ((val >> 15) & 1)) & 0x0F;
+    val <<= 1;
+  }
+}
+
 //******************************************************************************
 //Purpose:  Displays number from 1 to 128.  
 //******************************************************************************
 void LCDDecimal(unsigned char val)
 {
-  unsigned char low;
-  unsigned char med;
-  unsigned char high;
- 
-  //Get the lowest digit
-  low=val%10;
-
-  //shift right in decimal
-  val=val/10;
+  unsigned char digit[5];
  
-  //Get the second digit
-  med=val%10;
-;
-  //shift right in decimal
-  val=val/10;
- 
-  //get the high digit
-  high=val%10;
+  LCDDigits(val, digit);
  
   //Print the digits from high to low (left to right)
-  LCDNum(high);
-  LCDNum(med);
-  LCDNum(low);
+  LCDNum(digit[2]);
+  LCDNum(digit[3]);
+  LCDNum(digit[4]);
 }
 
 //******************************************************************************
@@ -691,45 +1676,16 @@ void LCDDecimal(unsigned char val)
 //******************************************************************************
 void LCDInt(unsigned int val)
 {
-   unsigned char part0;
-   unsigned char part1;
-   unsigned char part2;
-   unsigned char part3;
-   unsigned char part4;
- 
-  //get the first digit
-  part0=val%10;
-
-//shift right in decimal
-  val=val/10;
- 
-  //get the second digit
-  part1=val%10;
-
-//shift right in decimal
-  val=val/10;
- 
-  //get the third digit
-  part2=val%10;
-
-//shift right in decimal
-  val=val/10;
- 
-  //get the fourth digit
-  part3=val%10;
-
-//shift right in decimal
-  val=val/10;
+  unsigned char digit[5];
  
-  //get the fifth digit
-  part4=val%10;
+  LCDDigits(val, digit);
  
   //Print the digits from high to low (left to right)
-  LCDNum(part4);
-  LCDNum(part3);
-  LCDNum(part2);
-  LCDNum(part1);
-  LCDNum(part0);
+  LCDNum(digit[0]);
+  LCDNum(digit[1]);
+  LCDNum(digit[2]);
+  LCDNum(digit[3]);
+  LCDNum(digit[4]);
 }
 
 //******************************************************************************
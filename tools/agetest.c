@@ -0,0 +1,109 @@
+/*
+ * agetest: checks of the call age rules in motorController.
+ *
+ * explore gives every call the same age, so it never sees the deadline
+ * fire or the idle car at level 2 choose by age. This runs main.c's own
+ * IRQHan for one sensor IRQ at level 2 with level1 and level3 pending at
+ * set ages, and checks where the car goes. The ages are counted at the
+ * decision, after the stop delay. The tick count is just past its 16 bit
+ * wrap and every call was pressed before it, so each age spans the wrap.
+ *
+ *   agetest
+ *
+ * Exit status 1 if a check fails.
+ */
+#define main firmware_main
+#include "main_host.c"
+#undef main
+
+#include <stdio.h>
+
+#define NOW        10                     /* tick of the IRQ, just past the wrap */
+#define STOP_TICKS 25                     /* motorStop's delay, before the decision */
+#define NONE       -1
+
+struct test {
+  const char *what;
+  int dir;                                /* direction the car came in with */
+  int age1, age3;                         /* level1 and level3 ages, NONE: not pressed */
+  int next;                               /* floor the car should head for */
+};
+
+static const struct test tests[] = {
+  {"up past level 2, level1 one tick short of the deadline", 1,
+   CALL_DEADLINE - 1, 100, 3},
+  {"up past level 2, level1 at the deadline turns the car", 1,
+   CALL_DEADLINE, 100, 1},
+  {"down past level 2, level3 at the deadline turns the car", 2,
+   100, CALL_DEADLINE, 3},
+  {"down past level 2, level3 one tick short of the deadline", 2,
+   100, CALL_DEADLINE - 1, 1},
+  {"both past the deadline, the older one goes first", 1,
+   CALL_DEADLINE + 500, CALL_DEADLINE + 10, 1},
+  {"both past the deadline, the older one goes first", 2,
+   CALL_DEADLINE + 10, CALL_DEADLINE + 500, 3},
+  {"idle at level 2, level1 older", 0, 300, 200, 1},
+  {"idle at level 2, level3 older", 0, 200, 300, 3},
+  {"idle at level 2, same age goes to level1", 0, 250, 250, 1},
+  {"idle at level 2, level3 older by one tick", 0, 250, 251, 3},
+  {"idle at level 2, only level3", 0, NONE, 40, 3},
+};
+
+#define NTESTS (int)(sizeof tests / sizeof tests[0])
+
+static void wait10ms(void)
+{
+  ticks++;
+}
+
+static void press(unsigned char call, int age)
+{
+  if (age == NONE)
+    return;
+  ticks = NOW + STOP_TICKS - age;
+  callPress(call);
+}
+
+static int run(const struct test *t)
+{
+  int i;
+
+  pendingCalls = 0;
+  for (i = 0; i < CALL_COUNT; i++)
+    callBox[i] = 0;
+  wdState = WD_IDLE;
+  parkIdle = 0;
+  press(CALL_LEVEL1, t->age1);
+  press(CALL_LEVEL3, t->age3);
+
+  ticks = NOW;
+  currentstate = 2;                       /* the car was sent to level 2 */
+  direction = t->dir;
+  PTAD = 0x08;                            /* sensor 2 lit */
+  INTCR = 0x40;
+  IRQHan();
+  teleTail = teleHead;                    /* the SCI took it all */
+
+  return (int)currentstate;
+}
+
+int main(void)
+{
+  int i, fails = 0;
+
+  hostWait = wait10ms;
+  for (i = 0; i < NTESTS; i++) {
+    const struct test *t = &tests[i];
+    int got = run(t);
+
+    printf("  %s %s: level %d", got == t->next ? "ok  " : "FAIL", t->what,
+           got);
+    if (got != t->next) {
+      printf(", expected level %d", t->next);
+      fails++;
+    }
+    printf("\n");
+  }
+  printf("agetest: %s\n", fails ? "FAIL" : "ok");
+  return fails != 0;
+}
@@ -0,0 +1,790 @@
+/*
+ * explore: exhaustive check of the call arbitration in motorController.
+ *
+ * Runs main.c's own motorController from every state the car can reach,
+ * under every way keypad presses can interleave with the sensor IRQs, and
+ * reports for each call the most floor passes and sensor IRQs the car can
+ * make while the call waits. The worst case of each call is printed as a
+ * trace from reset. Run it after any change to the FSM; explore.out holds
+ * the output for the current main.c.
+ *
+ *   explore [-j threads]
+ *
+ * Exit status 1 if a call can wait without bound, the car can be driven
+ * past a terminal floor, or a call is cleared away from its floor.
+ *
+ * Model
+ *   state  currentstate, direction, the floor of the next sensor IRQ,
+ *          whether that IRQ is the sensor still lit as the car leaves,
+ *          and the 7 pending call bits: 54 blocks of 128 call sets.
+ *   step   one sensor IRQ. Any of the calls at that floor may be pressed
+ *          during the stop delay (through callPress, as XIRQ does) and
+ *          the traffic mode may be any of the four. A stopped car with no
+ *          calls pending or pressed may have stood idle long enough to
+ *          park, or not (parkIdle). Then any calls may be
+ *          pressed before the next IRQ. A parked car gets the IRQ again
+ *          at the same floor. A car that sets off gets one more from the
+ *          floor it leaves, and another after every stop delay it makes
+ *          there, since the sensor is still lit when the motor restarts;
+ *          then the next floor along. The IRQ after a stop delay comes at
+ *          once, so no call at that floor can be pressed before it; calls
+ *          pressed during the delay are the stop delay presses.
+ *   fixed  all calls have the same age, so the deadline never fires and
+ *          only calls pressed in the stop delay are younger. The watchdog
+ *          is idle.
+ *
+ * Search
+ *   The seven calls are tracked together, one bit each in a byte per
+ *   state meaning "this call can still be waiting", so one sweep is a few
+ *   byte ORs per transition for all calls at once. Calls pressed between
+ *   IRQs are any superset of the calls left pending; a superset-OR
+ *   transform over each block folds them in, over the calls away from
+ *   the floor only for the IRQ right after a stop delay. Every sweep
+ *   reads the last result and writes a new one, split over threads by
+ *   block, so the output does not depend on the thread count.
+ */
+#define _GNU_SOURCE
+#define main firmware_main
+#include "main_host.c"
+#undef main
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SETS     (1 << CALL_COUNT)       /* call sets per block */
+#define BLOCKS   54                      /* currentstate x direction x floor x repeat */
+#define STATES   (BLOCKS * SETS)
+#define EDGES    64                      /* stop delay presses x modes x next IRQ */
+#define KMAX     64                      /* more than this is unbounded */
+
+#define RUNAWAY  2                       /* edge.moved: driven past the end */
+
+struct edge {
+  unsigned char blk;                     /* block of the next state */
+  unsigned char calls;                   /* calls left pending */
+  unsigned char served;                  /* pending calls served at this IRQ */
+  unsigned char moved;                   /* 1: goes on to the next floor */
+  unsigned char dwell;                   /* pressed in the stop delay */
+  unsigned char mode;                    /* traffic mode */
+  unsigned char idle;                    /* parkIdle ran out */
+  unsigned char fixed;                   /* calls that cannot be pressed before
+                                            the next IRQ */
+};
+
+static struct edge edges[STATES][EDGES];
+static unsigned char nedges[STATES];
+static unsigned char reach[STATES];
+static int depth[STATES];                /* IRQs from reset */
+static int parent[STATES];
+static unsigned char parentEdge[STATES];
+
+static unsigned char passes[KMAX + 1][STATES];   /* can wait >= k floor passes */
+static unsigned short rank[KMAX + 1][STATES][CALL_COUNT];
+static unsigned char irqs[KMAX + 1][STATES];     /* can wait >= k IRQs */
+static unsigned char forever[STATES];            /* can wait without bound */
+static int passMax, irqMax;
+
+static int nthreads = 1;
+static unsigned long transitions;
+static int runaways, awayServes;
+
+static const char *callName[CALL_COUNT] = {"level1", "level2", "level3", "up1",
+                                           "up2", "down2", "down3"};
+static const char *dirName[3] = {"stop", "up", "down"};
+static const char *modeName[4] = {"idle", "up-peak", "down-peak", "interfloor"};
+
+/*---------------------------------------------------------------------------
+ * States
+ *-------------------------------------------------------------------------*/
+static int blockOf(int cs, int dir, int at, int rep)
+{
+  return (((cs - 1) * 3 + dir) * 3 + (at - 1)) * 2 + rep;
+}
+
+static void blockParts(int b, int *cs, int *dir, int *at, int *rep)
+{
+  *rep = b % 2;
+  b /= 2;
+  *at = b % 3 + 1;
+  b /= 3;
+  *dir = b % 3;
+  *cs = b / 3 + 1;
+}
+
+static unsigned char floorCalls(int floor)
+{
+  unsigned char m = 0;
+  int i;
+
+  for (i = 0; i < CALL_COUNT; i++)
+    if (callFloor[i] == floor)
+      m |= 1 << i;
+  return m;
+}
+
+/*---------------------------------------------------------------------------
+ * Running the firmware
+ *-------------------------------------------------------------------------*/
+static unsigned char dwellPress;
+static unsigned char stopped;            /* the stop delay ran */
+
+/* hostWait: the first 10ms wait of the stop delay presses the calls */
+static void dwellHook(void)
+{
+  int i;
+
+  stopped = 1;
+  if (!dwellPress)
+    return;
+  ticks = 1;                             /* younger than the pending calls */
+  for (i = 0; i < CALL_COUNT; i++)
+    if (dwellPress & (1 << i))
+      callPress(1 << i);
+  dwellPress = 0;
+}
+
+/* One sensor IRQ at floor at. Returns 0 if the car did not stop, so the
+   stop delay presses never happened. */
+static int fire(int cs, int dir, int at, int calls, int dwell, int mode,
+                int idle, int *cs2, int *dir2, int *calls2, int *served)
+{
+  int i;
+
+  ticks = 0;
+  pendingCalls = calls;
+  for (i = 0; i < CALL_COUNT; i++) {
+    callBox[i] = 0;
+    callTime[i] = 0;
+  }
+  currentstate = cs;
+  nextstate = cs;
+  direction = dir;
+  button = at;
+  wdState = WD_IDLE;
+  trafficMode = mode;
+  parkIdle = idle ? PARK_TICKS : 0;
+  dwellPress = dwell;
+  stopped = 0;
+
+  motorController();
+
+  teleTail = teleHead;                   /* the SCI took it all */
+  teleDrops = 0;
+  if (dwellPress)
+    return 0;
+
+  *cs2 = currentstate;
+  *dir2 = direction;
+  *calls2 = pendingCalls;
+  *served = 0;
+  for (i = 0; i < CALL_COUNT; i++) {
+    /* cleared, or cleared and pressed again in the stop delay */
+    if ((calls & (1 << i)) && (!(pendingCalls & (1 << i)) || callTime[i] == 1))
+      *served |= 1 << i;
+  }
+  return 1;
+}
+
+static void addEdge(int s, int blk, int calls, int served, int moved,
+                    int fixed, int dwell, int mode, int idle)
+{
+  struct edge *e = edges[s];
+  int i;
+
+  for (i = 0; i < nedges[s]; i++)
+    if (e[i].blk == blk && e[i].calls == calls && e[i].served == served &&
+        e[i].moved == moved && e[i].fixed == fixed)
+      return;
+  if (nedges[s] == EDGES) {
+    fprintf(stderr, "explore: too many transitions\n");
+    exit(2);
+  }
+  e = &edges[s][nedges[s]++];
+  e->blk = blk;
+  e->calls = calls;
+  e->served = served;
+  e->moved = moved;
+  e->fixed = fixed;
+  e->dwell = dwell;
+  e->mode = mode;
+  e->idle = idle;
+}
+
+/* The transitions of every state, straight from motorController */
+static void build(void)
+{
+  int b, m, d, k;
+
+  hostWait = dwellHook;
+  for (b = 0; b < BLOCKS; b++) {
+    int cs, dir, at, rep;
+    unsigned char here;
+
+    blockParts(b, &cs, &dir, &at, &rep);
+    here = floorCalls(at);
+    for (m = 0; m < SETS; m++) {
+      int s = b * SETS + m;
+
+      for (d = 0; d < SETS; d++) {
+        if (d & ~here)
+          continue;
+        for (k = 0; k < 8; k++) {
+          int mode = k / 2, idle = k % 2;
+          int cs2, dir2, calls2, served, next;
+
+          /* parkIdle only runs while stopped with no calls */
+          if (idle && (dir != 0 || m != 0 || d != 0))
+            continue;
+          if (!fire(cs, dir, at, m, d, mode, idle, &cs2, &dir2, &calls2,
+                    &served))
+            continue;
+          if (cs2 < 1 || cs2 > 3 || dir2 > 2) {
+            fprintf(stderr, "explore: bad state cs=%d dir=%d\n", cs2, dir2);
+            exit(2);
+          }
+          if (dir2 == 0) {
+            addEdge(s, blockOf(cs2, 0, at, 0), calls2, served, 0, 0, d, mode,
+                    idle);
+            continue;
+          }
+          if (!rep || stopped)
+            addEdge(s, blockOf(cs2, dir2, at, 1), calls2, served, 0,
+                    stopped ? here : 0, d, mode, idle);
+          next = at + (dir2 == 1 ? 1 : -1);
+          if (next < 1 || next > 3)
+            addEdge(s, b, calls2, served, RUNAWAY, 0, d, mode, idle);
+          else
+            addEdge(s, blockOf(cs2, dir2, next, 0), calls2, served, 1, 0, d,
+                    mode, idle);
+        }
+      }
+    }
+  }
+  hostWait = 0;
+}
+
+/* States reachable from reset: parked at level 1, any calls pressed */
+static void reachable(void)
+{
+  static int queue[STATES];
+  int head = 0, tail = 0, m;
+
+  for (m = 0; m < SETS; m++) {
+    int s = blockOf(1, 0, 1, 0) * SETS + m;
+
+    reach[s] = 1;
+    parent[s] = -1;
+    queue[tail++] = s;
+  }
+  while (head < tail) {
+    int s = queue[head++], i;
+
+    for (i = 0; i < nedges[s]; i++) {
+      const struct edge *e = &edges[s][i];
+
+      transitions++;
+      if (e->moved == RUNAWAY) {
+        runaways++;
+        continue;
+      }
+      if (e->served & ~floorCalls((s / SETS / 2) % 3 + 1))
+        awayServes++;
+      for (m = 0; m < SETS; m++) {
+        int t = e->blk * SETS + m;
+
+        if ((m & e->calls) != e->calls ||
+            (m & e->fixed) != (e->calls & e->fixed) || reach[t])
+          continue;
+        reach[t] = 1;
+        depth[t] = depth[s] + 1;
+        parent[t] = s;
+        parentEdge[t] = i;
+        queue[tail++] = t;
+      }
+    }
+  }
+}
+
+/*---------------------------------------------------------------------------
+ * Parallel sweeps
+ *-------------------------------------------------------------------------*/
+struct job {
+  void (*fn)(int blk, void *arg);
+  void *arg;
+  int id;
+};
+
+static void *worker(void *p)
+{
+  struct job *j = p;
+  int b;
+
+  for (b = j->id; b < BLOCKS; b += nthreads)
+    j->fn(b, j->arg);
+  return 0;
+}
+
+static void parallel(void (*fn)(int, void *), void *arg)
+{
+  pthread_t tid[64];
+  struct job job[64];
+  int i;
+
+  for (i = 0; i < nthreads; i++) {
+    job[i].fn = fn;
+    job[i].arg = arg;
+    job[i].id = i;
+    if (i > 0 && pthread_create(&tid[i], 0, worker, &job[i])) {
+      perror("pthread_create");
+      exit(2);
+    }
+  }
+  worker(&job[0]);
+  for (i = 1; i < nthreads; i++)
+    pthread_join(tid[i], 0);
+}
+
+struct supArg {
+  const unsigned char *x;
+  unsigned char *sup;
+  int away;                              /* add only calls away from the floor */
+};
+
+/* sup[m] = OR of x[m'] over every m' that is a superset of m */
+static void supBlock(int b, void *arg)
+{
+  struct supArg *a = arg;
+  unsigned char *sup = a->sup + b * SETS;
+  unsigned char keep = 0;
+  int cs, dir, at, rep, bit, m;
+
+  if (a->away) {
+    blockParts(b, &cs, &dir, &at, &rep);
+    keep = floorCalls(at);
+  }
+  memcpy(sup, a->x + b * SETS, SETS);
+  for (bit = 0; bit < CALL_COUNT; bit++) {
+    if (keep & (1 << bit))
+      continue;
+    for (m = 0; m < SETS; m++)
+      if (!(m & (1 << bit)))
+        sup[m] |= sup[m | (1 << bit)];
+  }
+}
+
+static void supOr(const unsigned char *x, unsigned char *sup, int away)
+{
+  struct supArg a;
+
+  a.x = x;
+  a.sup = sup;
+  a.away = away;
+  parallel(supBlock, &a);
+}
+
+struct sweep {
+  const unsigned char *moved;            /* value past an edge that moves */
+  const unsigned char *stay;             /* value past an edge that does not */
+  const unsigned char *fixed;            /* past one after a stop delay */
+  unsigned char *out;
+};
+
+/* A call can still be waiting if it is pending and some transition leaves
+   it unserved in a state where it can still be waiting */
+static void sweepBlock(int b, void *arg)
+{
+  struct sweep *w = arg;
+  int s;
+
+  for (s = b * SETS; s < (b + 1) * SETS; s++) {
+    unsigned char v = 0;
+    int i;
+
+    if (reach[s]) {
+      for (i = 0; i < nedges[s]; i++) {
+        const struct edge *e = &edges[s][i];
+        int t = e->blk * SETS + e->calls;
+
+        if (e->moved == RUNAWAY)
+          continue;
+        v |= (e->moved ? w->moved[t] : e->fixed ? w->fixed[t] : w->stay[t]) &
+             ~e->served;
+      }
+      v &= s % SETS;
+    }
+    w->out[s] = v;
+  }
+}
+
+static void sweep(const unsigned char *moved, const unsigned char *stay,
+                  const unsigned char *fixed, unsigned char *out)
+{
+  struct sweep w;
+
+  w.moved = moved;
+  w.stay = stay;
+  w.fixed = fixed;
+  w.out = out;
+  parallel(sweepBlock, &w);
+}
+
+static unsigned char lanes(const unsigned char *x)
+{
+  unsigned char v = 0;
+  int s;
+
+  for (s = 0; s < STATES; s++)
+    v |= x[s];
+  return v;
+}
+
+static void initLayer(unsigned char *x)
+{
+  int s;
+
+  for (s = 0; s < STATES; s++)
+    x[s] = reach[s] ? s % SETS : 0;
+}
+
+/* passes[k]: can wait for k more floor passes. Between passes the car may
+   make any number of IRQs, so each layer is the least fixpoint over the
+   transitions that do not move; rank records the sweep a call joined in,
+   which gives the traces something to count down. */
+static void searchPasses(void)
+{
+  static unsigned char supPrev[STATES], x[STATES], supX[STATES], awayX[STATES];
+  static unsigned char nx[STATES];
+  int k, s, i;
+
+  initLayer(passes[0]);
+  for (k = 1; k <= KMAX; k++) {
+    int round = 0;
+
+    supOr(passes[k - 1], supPrev, 0);
+    memset(x, 0, sizeof x);
+    for (;;) {
+      int changed = 0;
+
+      round++;
+      supOr(x, supX, 0);
+      supOr(x, awayX, 1);
+      sweep(supPrev, supX, awayX, nx);
+      for (s = 0; s < STATES; s++) {
+        unsigned char add = nx[s] & ~x[s];
+
+        if (!add)
+          continue;
+        changed = 1;
+        for (i = 0; i < CALL_COUNT; i++)
+          if (add & (1 << i))
+            rank[k][s][i] = round;
+      }
+      memcpy(x, nx, sizeof x);
+      if (!changed)
+        break;
+    }
+    memcpy(passes[k], x, sizeof x);
+    if (!lanes(x))
+      break;
+  }
+  passMax = k > KMAX ? KMAX : k;
+}
+
+/* irqs[k]: can wait for k more IRQs */
+static void searchIrqs(void)
+{
+  static unsigned char sup[STATES], away[STATES];
+  int k;
+
+  initLayer(irqs[0]);
+  for (k = 1; k <= KMAX; k++) {
+    supOr(irqs[k - 1], sup, 0);
+    supOr(irqs[k - 1], away, 1);
+    sweep(sup, sup, away, irqs[k]);
+    if (!lanes(irqs[k]))
+      break;
+  }
+  irqMax = k > KMAX ? KMAX : k;
+}
+
+/* forever: greatest fixpoint, a call that can be kept waiting for good */
+static void searchForever(void)
+{
+  static unsigned char sup[STATES], away[STATES], nx[STATES];
+
+  initLayer(forever);
+  for (;;) {
+    supOr(forever, sup, 0);
+    supOr(forever, away, 1);
+    sweep(sup, sup, away, nx);
+    if (memcmp(nx, forever, sizeof nx) == 0)
+      break;
+    memcpy(forever, nx, sizeof nx);
+  }
+}
+
+/*---------------------------------------------------------------------------
+ * Reports
+ *-------------------------------------------------------------------------*/
+static void printCalls(unsigned char m)
+{
+  int i, first = 1;
+
+  putchar('{');
+  for (i = 0; i < CALL_COUNT; i++) {
+    if (m & (1 << i)) {
+      printf(first ? "%s" : " %s", callName[i]);
+      first = 0;
+    }
+  }
+  putchar('}');
+}
+
+/* One IRQ of a trace: state s, transition e, next call set m */
+static void printStep(int n, int s, const struct edge *e, int m, int mark)
+{
+  int cs, dir, at, rep, cs2, dir2, at2, rep2;
+
+  blockParts(s / SETS, &cs, &dir, &at, &rep);
+  blockParts(e->blk, &cs2, &dir2, &at2, &rep2);
+  printf("  %3d%c IRQ level%d%s cs=%d %-4s pending ", n, mark ? '*' : ' ',
+         at, rep ? " (leaving)" : "", cs, dirName[dir]);
+  printCalls(s % SETS);
+  if (e->dwell) {
+    printf(" stop-press ");
+    printCalls(e->dwell);
+  }
+  if (e->mode)
+    printf(" mode %s", modeName[e->mode]);
+  if (e->idle)
+    printf(" idle");
+  printf(" -> cs=%d %s", cs2, dirName[dir2]);
+  if (e->served) {
+    printf(" served ");
+    printCalls(e->served);
+  }
+  if (m & ~e->calls) {
+    printf(" then press ");
+    printCalls(m & ~e->calls);
+  }
+  printf("\n");
+}
+
+/* Fewest extra presses m >= calls, none of them fixed, with call t set
+   in x */
+static int pickSet(const unsigned char *x, int blk, int calls, int fixed,
+                   int t, int (*ok)(int s, int t, void *), void *arg)
+{
+  int best = -1, bestBits = 99, m;
+
+  for (m = 0; m < SETS; m++) {
+    int s = blk * SETS + m;
+
+    if ((m & calls) != calls || (m & fixed) != (calls & fixed) ||
+        !(x[s] & (1 << t)))
+      continue;
+    if (ok && !ok(s, t, arg))
+      continue;
+    if (__builtin_popcount(m) < bestBits) {
+      best = m;
+      bestBits = __builtin_popcount(m);
+    }
+  }
+  return best;
+}
+
+/* Steps from reset to s; returns the step count */
+static int printPrefix(int s)
+{
+  int n;
+
+  if (parent[s] < 0) {
+    printf("       reset: car parked at level1, press ");
+    printCalls(s % SETS);
+    printf("\n");
+    return 0;
+  }
+  n = printPrefix(parent[s]) + 1;
+  printStep(n, parent[s], &edges[parent[s]][parentEdge[s]], s % SETS, 0);
+  return n;
+}
+
+/* Reachable state with call t in x, closest to reset */
+static int nearest(const unsigned char *x, int t)
+{
+  int s, best = -1;
+
+  for (s = 0; s < STATES; s++)
+    if (reach[s] && (x[s] & (1 << t)) && (best < 0 || depth[s] < depth[best]))
+      best = s;
+  return best;
+}
+
+struct rankArg {
+  int k, r;
+};
+
+static int rankBelow(int s, int t, void *p)
+{
+  struct rankArg *a = p;
+
+  return rank[a->k][s][t] < a->r;
+}
+
+/* The worst case of call t: k floor passes and it is still waiting */
+static void tracePasses(int t, int k)
+{
+  int s = nearest(passes[k], t), n;
+
+  n = printPrefix(s);
+  printf("       %s is pressed by here and still waits after:\n", callName[t]);
+  while (k > 0) {
+    int i, done = 0;
+
+    for (i = 0; i < nedges[s] && !done; i++) {
+      const struct edge *e = &edges[s][i];
+      struct rankArg a;
+      int m;
+
+      if (e->moved == RUNAWAY || (e->served & (1 << t)))
+        continue;
+      if (e->moved) {
+        m = pickSet(passes[k - 1], e->blk, e->calls, e->fixed, t, 0, 0);
+      } else {
+        a.k = k;
+        a.r = rank[k][s][t];
+        m = pickSet(passes[k], e->blk, e->calls, e->fixed, t, rankBelow, &a);
+      }
+      if (m < 0)
+        continue;
+      printStep(++n, s, e, m, e->moved);
+      k -= e->moved;
+      s = e->blk * SETS + m;
+      done = 1;
+    }
+    if (!done) {
+      printf("       (trace lost)\n");
+      return;
+    }
+  }
+}
+
+/* A lasso that keeps call t waiting for good */
+static void traceForever(int t)
+{
+  static int seen[STATES];
+  int s = nearest(forever, t), n;
+
+  memset(seen, 0, sizeof seen);
+  n = printPrefix(s);
+  printf("       %s is pressed by here and waits for good:\n", callName[t]);
+  while (!seen[s] && n < 200) {
+    int i, m = -1;
+    const struct edge *e = 0;
+
+    seen[s] = n + 1;
+    for (i = 0; i < nedges[s] && m < 0; i++) {
+      e = &edges[s][i];
+      if (e->moved != RUNAWAY && !(e->served & (1 << t)))
+        m = pickSet(forever, e->blk, e->calls, e->fixed, t, 0, 0);
+    }
+    if (m < 0) {
+      printf("       (trace lost)\n");
+      return;
+    }
+    printStep(++n, s, e, m, e->moved == 1);
+    s = e->blk * SETS + m;
+  }
+  printf("       repeats from step %d\n", seen[s]);
+}
+
+static int deepest(unsigned char x[][STATES], int kmax, int t)
+{
+  int k;
+
+  for (k = kmax; k > 0; k--)
+    if (lanes(x[k]) & (1 << t))
+      return k;
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  struct timespec t0, t1;
+  unsigned char unbounded;
+  int s, t, nreach = 0, fail = 0;
+
+  nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+  if (argc == 3 && strcmp(argv[1], "-j") == 0)
+    nthreads = atoi(argv[2]);
+  else if (argc != 1) {
+    fprintf(stderr, "usage: explore [-j threads]\n");
+    return 2;
+  }
+  if (nthreads < 1)
+    nthreads = 1;
+  if (nthreads > 64)
+    nthreads = 64;
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  build();
+  reachable();
+  searchPasses();
+  searchIrqs();
+  searchForever();
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+
+  for (s = 0; s < STATES; s++)
+    nreach += reach[s];
+  unbounded = lanes(forever);
+
+  printf("explore: %d of %d states reachable, %lu transitions\n", nreach,
+         STATES, transitions);
+  printf("\n%-8s %-6s %-10s %s\n", "call", "floor", "passes", "irqs");
+  for (t = 0; t < CALL_COUNT; t++) {
+    if (unbounded & (1 << t))
+      printf("%-8s %-6d %-10s %s\n", callName[t], callFloor[t], "unbounded",
+             "unbounded");
+    else
+      printf("%-8s %-6d %-10d %d\n", callName[t], callFloor[t],
+             deepest(passes, passMax, t), deepest(irqs, irqMax, t));
+  }
+  printf("\nA step is one sensor IRQ; after a step marked * the car travels on to the\n"
+         "next floor. (leaving) is the IRQ again from the floor the car leaves;\n"
+         "right after a stop delay no call at that floor is pressed before it.\n");
+
+  for (t = 0; t < CALL_COUNT; t++) {
+    int k = deepest(passes, passMax, t);
+
+    printf("\n%s: ", callName[t]);
+    if (unbounded & (1 << t)) {
+      printf("can wait without bound\n");
+      traceForever(t);
+      fail = 1;
+    } else if (k > 0) {
+      printf("waits at most %d floor passes\n", k);
+      tracePasses(t, k);
+    } else {
+      printf("served before the car passes a floor\n");
+    }
+  }
+
+  if (runaways) {
+    printf("\nFAIL: %d transitions drive the car past a terminal floor\n",
+           runaways);
+    fail = 1;
+  }
+  if (awayServes) {
+    printf("\nFAIL: %d transitions clear a call away from its floor\n",
+           awayServes);
+    fail = 1;
+  }
+
+  fprintf(stderr, "explore: %.2fs with %d threads\n",
+          (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9, nthreads);
+  return fail;
+}
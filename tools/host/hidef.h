@@ -0,0 +1,9 @@
+/* Host stand-in for the CodeWarrior hidef.h: interrupts are simulated by
+   the tool calling the handlers, so masking them is a no-op. */
+#ifndef HIDEF_H
+#define HIDEF_H
+
+#define EnableInterrupts
+#define DisableInterrupts
+
+#endif
@@ -0,0 +1,45 @@
+/* Register variables for the host build of main.c, see mc9s12c32.h */
+#include "mc9s12c32.h"
+
+#define HOST_DEF8(x)  volatile unsigned char x;
+#define HOST_DEF16(x) volatile unsigned short x;
+
+HOST_DEF8(PTT) HOST_DEF8(PTAD) HOST_DEF8(DDRT) HOST_DEF8(PPST) HOST_DEF8(PERT)
+HOST_DEF8(DDRAD) HOST_DEF8(ATDDIEN) HOST_DEF8(DDRE) HOST_DEF8(DDRP)
+HOST_DEF8(PWME) HOST_DEF8(PWMPOL) HOST_DEF8(PWMCLK) HOST_DEF8(PWMPRCLK)
+HOST_DEF8(PWMSCLA) HOST_DEF8(PWMPER5) HOST_DEF8(PWMDTY5)
+HOST_DEF8(TIOS) HOST_DEF8(TSCR1) HOST_DEF8(TSCR2) HOST_DEF8(TFLG1) HOST_DEF8(TIE)
+HOST_DEF16(TC6) HOST_DEF8(INTCR)
+HOST_DEF8(SPICR1) HOST_DEF8(SPICR2) HOST_DEF8(SPIBR) HOST_DEF8(SPISR)
+HOST_DEF8(SCIBDH) HOST_DEF8(SCIBDL) HOST_DEF8(SCICR1) HOST_DEF8(SCICR2)
+HOST_DEF8(SCISR1) HOST_DEF8(SCIDRL)
+
+void (*hostWait)(void) = 0;
+static volatile unsigned short tc5;
+
+volatile unsigned short *hostTC5(void)
+{
+  if (hostWait)
+    hostWait();
+  return &tc5;
+}
+
+volatile unsigned short hostTcnt;
+unsigned short hostTcntStep = 0;
+unsigned long hostTcntReads = 0;
+
+volatile unsigned short *hostTCNT(void)
+{
+  hostTcnt += hostTcntStep;
+  hostTcntReads++;
+  return &hostTcnt;
+}
+
+unsigned long hostSpiWrites = 0;
+static volatile unsigned char spidr;
+
+volatile unsigned char *hostSPIDR(void)
+{
+  hostSpiWrites++;
+  return &spidr;
+}
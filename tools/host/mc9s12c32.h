@@ -0,0 +1,46 @@
+/* Host stand-in for the MC9S12C32 register header. Every register main.c
+   uses is a plain variable in hostregs.c, except TC5, TCNT and SPIDR. The
+   only use of TC5 is the start of Timer_Wait10ms, so each write calls
+   hostWait. A tool lets simulated time pass there, the way the tick keeps
+   running while the firmware waits. Each use of TCNT first adds
+   hostTcntStep to it, so code between two reads of TCNT takes time; a
+   tool sets the step to give the handlers a known cost. SPIDR counts its
+   uses in hostSpiWrites, one per byte spiWR sends the LCD. The 16 bit
+   registers are 16 bit here too, so TCNT wraps as on the board. */
+#ifndef MC9S12C32_H
+#define MC9S12C32_H
+
+#define HOST_R8(x)  extern volatile unsigned char x;
+#define HOST_R16(x) extern volatile unsigned short x;
+
+HOST_R8(PTT) HOST_R8(PTAD) HOST_R8(DDRT) HOST_R8(PPST) HOST_R8(PERT)
+HOST_R8(DDRAD) HOST_R8(ATDDIEN) HOST_R8(DDRE) HOST_R8(DDRP)
+HOST_R8(PWME) HOST_R8(PWMPOL) HOST_R8(PWMCLK) HOST_R8(PWMPRCLK)
+HOST_R8(PWMSCLA) HOST_R8(PWMPER5) HOST_R8(PWMDTY5)
+HOST_R8(TIOS) HOST_R8(TSCR1) HOST_R8(TSCR2) HOST_R8(TFLG1) HOST_R8(TIE)
+HOST_R16(TC6) HOST_R8(INTCR)
+HOST_R8(SPICR1) HOST_R8(SPICR2) HOST_R8(SPIBR) HOST_R8(SPISR)
+HOST_R8(SCIBDH) HOST_R8(SCIBDL) HOST_R8(SCICR1) HOST_R8(SCICR2)
+HOST_R8(SCISR1) HOST_R8(SCIDRL)
+
+extern void (*hostWait)(void);
+volatile unsigned short *hostTC5(void);
+#define TC5 (*hostTC5())
+
+extern volatile unsigned short hostTcnt;  /* TCNT without the step */
+extern unsigned short hostTcntStep;
+extern unsigned long hostTcntReads;
+volatile unsigned short *hostTCNT(void);
+#define TCNT (*hostTCNT())
+
+extern unsigned long hostSpiWrites;
+volatile unsigned char *hostSPIDR(void);
+#define SPIDR (*hostSPIDR())
+
+#define PTAD_PTAD7_MASK   0x80
+#define PTAD_PTAD6_MASK   0x40
+#define SCICR2_TE_MASK    0x08
+#define SCICR2_TIE_MASK   0x80
+#define SCISR1_TDRE_MASK  0x80
+
+#endif
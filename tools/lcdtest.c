@@ -0,0 +1,136 @@
+/*
+ * lcdtest: checks of the LCD frame buffer and its refresh.
+ *
+ * Runs main.c's own scanIRSensor and XIRQHan for a run of status updates
+ * and, after each, LCDRefresh as the main loop does. Each status field
+ * must land at its own cells and leave the rest of the display alone,
+ * and the refresh must send only the cells that changed: a run of n
+ * changed cells costs one LCDGoto and n LCDData, 6 bytes over the SPI
+ * each. A status that repeats, as the IRQ does while the car stands at a
+ * floor, costs nothing. Also checks LCDDigits against printf for every
+ * 16 bit value.
+ *
+ *   lcdtest
+ *
+ * Exit status 1 if a check fails.
+ */
+#define main firmware_main
+#include "main_host.c"
+#undef main
+
+#include <stdio.h>
+#include <string.h>
+
+#define SPI_RUN  6                        /* LCDGoto: two LCDWR of 3 bytes */
+#define SPI_CELL 6                        /* LCDData: two nibbles of 3 bytes */
+#define XIRQ     -1
+
+struct step {
+  const char *what;
+  int sensors;                            /* PTAD & 0x1C, or XIRQ */
+  const char *line1, *line2;              /* the whole display after it */
+  int spi;                                /* bytes the refresh sends */
+};
+
+static const struct step steps[] = {
+  {"sensor 1", 0x04, "IR1             ", "                ",
+   SPI_RUN + 3 * SPI_CELL},
+  {"sensor 1 again", 0x04, "IR1             ", "                ", 0},
+  {"sensor 2", 0x08, "IR2             ", "                ",
+   SPI_RUN + SPI_CELL},
+  {"sensor 3", 0x10, "IR3             ", "                ",
+   SPI_RUN + SPI_CELL},
+  {"sensors 2 and 3", 0x18, "IRErr 024       ", "                ",
+   2 * SPI_RUN + 6 * SPI_CELL},
+  {"all three sensors", 0x1C, "IRErr 028       ", "                ",
+   SPI_RUN + SPI_CELL},
+  {"sensor 1 after the error", 0x04, "IR1             ", "                ",
+   2 * SPI_RUN + 6 * SPI_CELL},
+  {"first keypad interrupt", XIRQ, "IR1             ", "XIRQ 00001      ",
+   2 * SPI_RUN + 9 * SPI_CELL},
+  {"second keypad interrupt", XIRQ, "IR1             ", "XIRQ 00002      ",
+   SPI_RUN + SPI_CELL},
+  {"sensor 1 again", 0x04, "IR1             ", "XIRQ 00002      ", 0},
+};
+
+#define NSTEPS (int)(sizeof steps / sizeof steps[0])
+
+static int fails;
+
+static void check(int ok, const char *what, int n)
+{
+  if (!ok) {
+    printf("  FAIL %s", what);
+    if (n >= 0)
+      printf(" %d", n);
+    printf("\n");
+    fails++;
+  }
+}
+
+static void runSteps(void)
+{
+  char want[LCD_CELLS + 1], shown[LCD_CELLS + 1];
+  unsigned long spi;
+  int i;
+
+  for (i = 0; i < NSTEPS; i++) {
+    const struct step *s = &steps[i];
+
+    lcdCursor = 7;                        /* where an IRQ side write had got to */
+    if (s->sensors == XIRQ) {
+      XIRQHan();
+      check(lcdCursor == 7, "XIRQ moved the cursor to", lcdCursor);
+    } else {
+      PTAD = s->sensors;
+      scanIRSensor();
+    }
+    teleTail = teleHead;                  /* the SCI took it all */
+
+    spi = hostSpiWrites;
+    LCDRefresh();
+    spi = hostSpiWrites - spi;
+
+    snprintf(want, sizeof want, "%s%s", s->line1, s->line2);
+    memcpy(shown, lcdShown, LCD_CELLS);
+    shown[LCD_CELLS] = 0;
+    printf("  %-26s |%.16s|%.16s| %3lu SPI bytes\n", s->what, shown,
+           shown + LCD_COLS, spi);
+    check(strcmp(shown, want) == 0, "display shows", -1);
+    check(memcmp(lcdFrame, lcdShown, LCD_CELLS) == 0, "refresh left cells",
+          -1);
+    check((int)spi == s->spi, "SPI bytes, expected", s->spi);
+  }
+}
+
+static void checkDigits(void)
+{
+  unsigned char digit[5];
+  char want[8];
+  unsigned long v;
+  int j, bad = 0;
+
+  for (v = 0; v < 0x10000; v++) {
+    LCDDigits((unsigned int)v, digit);
+    snprintf(want, sizeof want, "%05lu", v);
+    for (j = 0; j < 5; j++)
+      if (digit[j] != want[j] - '0')
+        break;
+    if (j < 5 && bad++ < 5)
+      printf("  FAIL LCDDigits(%lu) gave %d%d%d%d%d\n", v, digit[0], digit[1],
+             digit[2], digit[3], digit[4]);
+  }
+  printf("  LCDDigits: 65536 values, %d wrong\n", bad);
+  if (bad)
+    fails++;
+}
+
+int main(void)
+{
+  SPISR = 0x20;                           /* the SPI is always ready */
+  LCDInit();
+  runSteps();
+  checkDigits();
+  printf("lcdtest: %s\n", fails ? "FAIL" : "ok");
+  return fails != 0;
+}
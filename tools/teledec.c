@@ -0,0 +1,416 @@
+/*
+ * teledec: decode the controller's SCI telemetry stream on a Linux host.
+ *
+ *   teledec [-q | -l] [device-or-file]
+ *
+ * Reads the stream from a serial device (set to 9600 8N1 raw), a capture
+ * file, or stdin, and prints one line per record with the time since the
+ * stream started. After each LOAD record a STATS line gives the running
+ * call wait times, taken from SERVICE records, and the mean handler load
+ * so far. With -l only the STATS lines are printed, with -q neither. The
+ * summary, on end of input or SIGINT, gives the same figures in full and
+ * the call age histogram from the latest AGE record.
+ *
+ * The frame format is described above SCI_Init in main.c. Frames that fail
+ * the check byte are counted as bad and skipped by resyncing on the next
+ * 0xA5; bytes outside any frame are counted as skipped.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#define SYNC       0xA5
+#define TICK_SEC   0.01          /* one firmware tick */
+#define TCNT_SEC   4e-6          /* one TCNT count */
+#define HANDLERS   4
+#define AGE_BUCKETS 8
+#define MAXPAYLOAD 16            /* LOAD and AGE */
+
+static const char *handlerName[HANDLERS] = {"irq", "xirq", "tick", "sci"};
+static const char *callName[7] = {"level1", "level2", "level3", "up1",
+                                  "up2", "down2", "down3"};
+static const char *faultName[9] = {"?", "stall", "missed", "resync", "gaveup",
+                                   "badread", "out1", "out2", "out3"};
+static const char *modeName[4] = {"idle", "up-peak", "down-peak", "interfloor"};
+
+struct dec {
+  unsigned char buf[64];          /* bytes not yet consumed */
+  int len;
+  unsigned long time;             /* ticks since the stream began */
+  int quiet;                      /* 1: summary only, 2: STATS lines too */
+
+  unsigned long frames, bad, skipped, drops;  /* bad: sync without a frame */
+  int state, dir, calls, duty;    /* last STATE fields */
+
+  unsigned int *waits;            /* SERVICE ages in ticks, sorted */
+  size_t nwaits, capwaits;
+
+  unsigned long loadStart;        /* end of the previous LOAD window */
+  unsigned long loadWindows, loadTicks;
+  double waitSum;
+  unsigned long loadCount[HANDLERS];
+  double loadBusy[HANDLERS];      /* TCNT counts */
+  double loadPeak[HANDLERS];      /* highest busy fraction of one window */
+
+  int haveAges;
+  unsigned int ages[AGE_BUCKETS]; /* latest AGE record, calls served by age */
+};
+
+static volatile sig_atomic_t stop;
+
+static void onSignal(int sig)
+{
+  (void)sig;
+  stop = 1;
+}
+
+/* Payload length of a record from its type byte, -1 if unknown */
+static int payloadLen(unsigned char type)
+{
+  unsigned char f = type & 0x0F;
+
+  switch (type & 0xF0) {
+  case 0x10: return (f & 1) + ((f >> 1) & 1) + ((f >> 2) & 1) + ((f >> 3) & 1);
+  case 0x20: case 0x30: case 0x40: case 0x60: case 0x70:
+    return f == 0 ? 1 : -1;
+  case 0x50: return f == 0 ? 3 : -1;
+  case 0x80: return f == 0 ? 4 * HANDLERS : -1;
+  case 0x90: return f == 0 ? 2 * AGE_BUCKETS : -1;
+  default:   return -1;
+  }
+}
+
+/* Nearest rank percentile of sorted values */
+static unsigned int percentile(const unsigned int *v, size_t n, int pct)
+{
+  size_t rank = (n * pct + 99) / 100;
+
+  return v[rank ? rank - 1 : 0];
+}
+
+/* Keep the waits sorted as they come, so the statistics are always ready */
+static void addWait(struct dec *d, unsigned int age)
+{
+  size_t k;
+
+  if (d->nwaits == d->capwaits) {
+    d->capwaits = d->capwaits ? 2 * d->capwaits : 256;
+    d->waits = realloc(d->waits, d->capwaits * sizeof *d->waits);
+    if (!d->waits) {
+      perror("teledec");
+      exit(1);
+    }
+  }
+  k = d->nwaits;
+  while (k > 0 && d->waits[k - 1] > age) {
+    d->waits[k] = d->waits[k - 1];
+    k--;
+  }
+  d->waits[k] = age;
+  d->nwaits++;
+  d->waitSum += age;
+}
+
+static void printWaits(const struct dec *d)
+{
+  if (d->nwaits == 0) {
+    printf("wait n=0");
+    return;
+  }
+  printf("wait n=%lu mean=%.2fs p50=%.2fs p90=%.2fs p99=%.2fs max=%.2fs",
+         (unsigned long)d->nwaits, d->waitSum / d->nwaits * TICK_SEC,
+         percentile(d->waits, d->nwaits, 50) * TICK_SEC,
+         percentile(d->waits, d->nwaits, 90) * TICK_SEC,
+         percentile(d->waits, d->nwaits, 99) * TICK_SEC,
+         d->waits[d->nwaits - 1] * TICK_SEC);
+}
+
+/* Mean busy fraction of handler i over the LOAD windows so far */
+static double loadMean(const struct dec *d, int i)
+{
+  double span = d->loadTicks * TICK_SEC;
+
+  return span > 0 ? d->loadBusy[i] * TCNT_SEC / span : 0.0;
+}
+
+/* The AGE buckets: n holds ages under 64 << n ticks, the last one the rest */
+static void printAges(const struct dec *d)
+{
+  int i;
+
+  for (i = 0; i < AGE_BUCKETS; i++)
+    printf(" %s%.2fs %u", i < AGE_BUCKETS - 1 ? "<" : ">=",
+           (64 << (i < AGE_BUCKETS - 1 ? i : i - 1)) * TICK_SEC, d->ages[i]);
+}
+
+static const char *callText(unsigned char bit)
+{
+  int i;
+
+  for (i = 0; i < 7; i++)
+    if (bit == (1 << i))
+      return callName[i];
+  return "?";
+}
+
+static void record(struct dec *d, const unsigned char *p, int n)
+{
+  unsigned char type = p[0];
+  const unsigned char *v = p + 1;
+  double sec = d->time * TICK_SEC;
+  int i;
+
+  (void)n;
+  switch (type & 0xF0) {
+  case 0x10:
+    i = 0;
+    if (type & 1) d->state = v[i++];
+    if (type & 2) d->dir = v[i++];
+    if (type & 4) d->calls = v[i++];
+    if (type & 8) d->duty = v[i++];
+    if (!d->quiet)
+      printf("%9.2f STATE   state=%d dir=%d calls=%02x duty=%d%s\n", sec,
+             d->state, d->dir, d->calls & 0xFF, d->duty,
+             (type & 0x0F) == 0x0F ? " (key)" : "");
+    break;
+  case 0x20:
+    if (!d->quiet)
+      printf("%9.2f SENSOR  %02x\n", sec, v[0]);
+    break;
+  case 0x30:
+    if (!d->quiet)
+      printf("%9.2f KEY     %d\n", sec, v[0]);
+    break;
+  case 0x40:
+    d->drops += v[0];
+    if (!d->quiet)
+      printf("%9.2f DROP    %d\n", sec, v[0]);
+    break;
+  case 0x50: {
+    unsigned int age = (v[1] << 8) | v[2];
+
+    addWait(d, age);
+    if (!d->quiet)
+      printf("%9.2f SERVICE %s waited %.2fs\n", sec, callText(v[0]),
+             age * TICK_SEC);
+    break;
+  }
+  case 0x60:
+    if (!d->quiet)
+      printf("%9.2f FAULT   %s\n", sec, v[0] < 9 ? faultName[v[0]] : "?");
+    break;
+  case 0x70:
+    if (!d->quiet)
+      printf("%9.2f MODE    %s\n", sec, v[0] < 4 ? modeName[v[0]] : "?");
+    break;
+  case 0x80: {
+    unsigned long win = d->time - d->loadStart;
+
+    if (!d->quiet)
+      printf("%9.2f LOAD   ", sec);
+    for (i = 0; i < HANDLERS; i++) {
+      unsigned int count = (v[4 * i] << 8) | v[4 * i + 1];
+      unsigned int busy = (v[4 * i + 2] << 8) | v[4 * i + 3];
+      double frac = win ? busy * TCNT_SEC / (win * TICK_SEC) : 0;
+
+      d->loadCount[i] += count;
+      d->loadBusy[i] += busy;
+      if (frac > d->loadPeak[i])
+        d->loadPeak[i] = frac;
+      if (!d->quiet)
+        printf(" %s %u %.1f%%", handlerName[i], count, 100 * frac);
+    }
+    if (!d->quiet)
+      printf("  (%.2fs)\n", win * TICK_SEC);
+    d->loadWindows++;
+    d->loadTicks += win;
+    d->loadStart = d->time;
+    if (d->quiet != 1) {
+      printf("%9.2f STATS   ", sec);
+      printWaits(d);
+      printf("  load");
+      for (i = 0; i < HANDLERS; i++)
+        printf(" %s %.2f%%", handlerName[i], 100 * loadMean(d, i));
+      printf("\n");
+    }
+    break;
+  }
+  case 0x90:
+    for (i = 0; i < AGE_BUCKETS; i++)
+      d->ages[i] = (v[2 * i] << 8) | v[2 * i + 1];
+    d->haveAges = 1;
+    if (!d->quiet) {
+      printf("%9.2f AGE    ", sec);
+      printAges(d);
+      printf("\n");
+    }
+    break;
+  }
+}
+
+/* Decode as many whole frames as the buffer holds */
+static void scan(struct dec *d)
+{
+  for (;;) {
+    int start = 0, tlen, plen, flen, i;
+    unsigned char chk;
+
+    while (start < d->len && d->buf[start] != SYNC)
+      start++;
+    if (start) {
+      d->skipped += start;
+      memmove(d->buf, d->buf + start, d->len - start);
+      d->len -= start;
+    }
+    if (d->len < 3)
+      return;
+    plen = payloadLen(d->buf[1]);
+    if (plen < 0)
+      goto resync;
+    tlen = d->buf[2] == 0xFF ? 3 : 1;
+    flen = 2 + tlen + plen + 1;
+    if (d->len < flen)
+      return;
+    chk = 0;
+    for (i = 1; i < flen - 1; i++)
+      chk ^= d->buf[i];
+    if (chk != d->buf[flen - 1])
+      goto resync;
+
+    if (tlen == 1) {
+      d->time += d->buf[2];
+    } else {
+      unsigned long abs = (d->buf[3] << 8) | d->buf[4];
+      unsigned long t = (d->time & ~0xFFFFUL) | abs;
+
+      if (t < d->time)
+        t += 0x10000UL;
+      d->time = t;
+    }
+    d->frames++;
+    {
+      unsigned char rec[1 + MAXPAYLOAD];
+
+      rec[0] = d->buf[1];
+      memcpy(rec + 1, d->buf + 2 + tlen, plen);
+      record(d, rec, plen + 1);
+    }
+    memmove(d->buf, d->buf + flen, d->len - flen);
+    d->len -= flen;
+    continue;
+
+  resync:
+    /* not a frame: drop this sync byte and look for the next one */
+    d->bad++;
+    memmove(d->buf, d->buf + 1, d->len - 1);
+    d->len--;
+  }
+}
+
+static void feed(struct dec *d, const unsigned char *p, size_t n)
+{
+  while (n) {
+    size_t k = sizeof d->buf - d->len;
+
+    if (k > n)
+      k = n;
+    memcpy(d->buf + d->len, p, k);
+    d->len += k;
+    p += k;
+    n -= k;
+    scan(d);
+  }
+}
+
+static void summary(const struct dec *d)
+{
+  int i;
+
+  printf("frames %lu bad %lu skipped %lu dropped %lu time %.2fs\n", d->frames,
+         d->bad, d->skipped, d->drops, d->time * TICK_SEC);
+  printWaits(d);
+  printf("\n");
+  printf("load windows=%lu time=%.2fs\n", d->loadWindows,
+         d->loadTicks * TICK_SEC);
+  for (i = 0; i < HANDLERS; i++) {
+    double span = d->loadTicks * TICK_SEC;
+
+    printf("load %-4s entries=%lu rate=%.1f/s busy=%.1fms mean=%.2f%% peak=%.2f%%\n",
+           handlerName[i], d->loadCount[i],
+           span > 0 ? d->loadCount[i] / span : 0.0,
+           d->loadBusy[i] * TCNT_SEC * 1000,
+           100 * loadMean(d, i),
+           100 * d->loadPeak[i]);
+  }
+  if (d->haveAges) {
+    printf("age");
+    printAges(d);
+    printf("\n");
+  }
+}
+
+int main(int argc, char **argv)
+{
+  static struct dec d;
+  unsigned char chunk[256];
+  struct sigaction sa;
+  int fd = 0;
+  int i;
+
+  for (i = 1; i < argc && argv[i][0] == '-' && argv[i][1]; i++) {
+    if (strcmp(argv[i], "-q") == 0) {
+      d.quiet = 1;
+    } else if (strcmp(argv[i], "-l") == 0) {
+      d.quiet = 2;
+    } else {
+      fprintf(stderr, "usage: teledec [-q | -l] [device-or-file]\n");
+      return 2;
+    }
+  }
+  if (i < argc && strcmp(argv[i], "-") != 0) {
+    fd = open(argv[i], O_RDONLY | O_NOCTTY);
+    if (fd < 0) {
+      perror(argv[i]);
+      return 1;
+    }
+  }
+  if (isatty(fd)) {
+    struct termios tio;
+
+    if (tcgetattr(fd, &tio) == 0) {
+      cfmakeraw(&tio);
+      cfsetispeed(&tio, B9600);
+      cfsetospeed(&tio, B9600);
+      tio.c_cflag |= CLOCAL | CREAD;
+      tio.c_cc[VMIN] = 1;
+      tio.c_cc[VTIME] = 0;
+      tcsetattr(fd, TCSANOW, &tio);
+    }
+  }
+
+  memset(&sa, 0, sizeof sa);
+  sa.sa_handler = onSignal;
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+
+  while (!stop) {
+    ssize_t n = read(fd, chunk, sizeof chunk);
+
+    if (n > 0) {
+      feed(&d, chunk, n);
+      if (d.quiet != 1)
+        fflush(stdout);
+    } else if (n < 0 && errno == EINTR) {
+      continue;
+    } else {
+      break;                      /* end of file, or the pty was hung up */
+    }
+  }
+  summary(&d);
+  return 0;
+}
@@ -0,0 +1,247 @@
+/*
+ * teledec_test: end to end check of the telemetry path on the host.
+ *
+ * Runs the firmware's own IRQHan, TickHan, SCIHan and call code with the
+ * car parked at level 1, serving ten calls with known waits. Each byte
+ * SCIHan sends is written to a pseudo terminal, with some line noise in
+ * front, and teledec reads the other side like a serial port. The test
+ * then checks teledec's running STATS lines and its wait time, load and
+ * call age summary against what the firmware did. The tick count starts just short of its 16 bit wrap, so
+ * the firmware's wrapping time arithmetic is part of the check.
+ *
+ * Every read of TCNT costs STEP counts, so each handler takes a known time
+ * between its entry and exit reads: SCIHan one step, TickHan one step and
+ * one more when it books a running IRQHan, IRQHan the ticks of its stop
+ * delay plus the steps of every read it makes after its first one.
+ */
+#define _GNU_SOURCE
+#define main firmware_main
+#include "main_host.c"
+#undef main
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <unistd.h>
+
+#define SERVED 10
+#define START  (0x10000 - 500)            /* firmware tick count at the start */
+#define STEP   10                         /* TCNT counts per read of TCNT */
+#define STOP_TICKS 25                     /* motorStop's delay, a call is served after it */
+
+static int master;
+static unsigned long irqBusy;             /* TCNT counts IRQHan ran for */
+static unsigned int nested;               /* ticks inside IRQHan */
+
+static void put(const unsigned char *p, size_t n)
+{
+  while (n) {
+    ssize_t k = write(master, p, n);
+
+    if (k < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("write pty");
+      exit(1);
+    }
+    p += k;
+    n -= k;
+  }
+}
+
+/* The time one sensor IRQ takes, counted apart from the firmware's count */
+static void irq(void)
+{
+  unsigned long reads = hostTcntReads;
+
+  IRQHan();
+  irqBusy += STEP * (hostTcntReads - reads - 1);
+}
+
+/* Let SCIHan empty the ring, one byte per TDRE */
+static void drain(void)
+{
+  unsigned char out[TELE_SIZE];
+  size_t n = 0;
+
+  SCISR1 = SCISR1_TDRE_MASK;
+  while (teleTail != teleHead) {
+    SCIHan();
+    out[n++] = SCIDRL;
+  }
+  SCIHan();                               /* sees the ring empty */
+  put(out, n);
+}
+
+/* One 10ms tick of simulated time */
+static void tick(void)
+{
+  hostTcnt += TICK_PERIOD;
+  if (loadIrqRun) {
+    irqBusy += TICK_PERIOD;
+    nested++;
+  }
+  TickHan();
+  drain();
+}
+
+static void runTicks(int n)
+{
+  while (n-- > 0)
+    tick();
+}
+
+static int cmpInt(const void *a, const void *b)
+{
+  return *(const int *)a - *(const int *)b;
+}
+
+int main(void)
+{
+  static const unsigned char noise[] = {0x00, 0x13, TELE_SYNC, 0x80, 0x01};
+  static const unsigned char badFrame[] = {TELE_SYNC, TELE_KEY, 0x01, 18, 0x00};
+  int waits[SERVED], sorted[SERVED];
+  char expect[10][200];
+  int ages[AGE_BUCKETS] = {0};
+  size_t len;
+  static char output[65536];
+  struct termios tio;
+  char *name;
+  int slave, pipefd[2], status, failed = 0, i, pending;
+  unsigned int span;
+  size_t got = 0;
+  double mean = 0;
+  pid_t pid;
+  ssize_t k;
+
+  master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master < 0 || grantpt(master) || unlockpt(master)) {
+    perror("pty");
+    return 1;
+  }
+  name = ptsname(master);
+  slave = name ? open(name, O_RDWR | O_NOCTTY) : -1;
+  if (slave < 0 || tcgetattr(slave, &tio)) {
+    perror("pty slave");
+    return 1;
+  }
+  cfmakeraw(&tio);                        /* raw before the first byte */
+  tcsetattr(slave, TCSANOW, &tio);
+
+  if (pipe(pipefd)) {
+    perror("pipe");
+    return 1;
+  }
+  pid = fork();
+  if (pid == 0) {
+    dup2(pipefd[1], 1);
+    close(pipefd[0]);
+    close(master);
+    execl("./teledec", "teledec", "-l", name, (char *)0);
+    perror("exec teledec");
+    _exit(127);
+  }
+  close(pipefd[1]);
+
+  /* firmware parked at level 1, sensor 1 lit, time near the wrap */
+  ticks = teleLast = loadStart = trafficStart = START;
+  hostTcnt = 0x10000 - 3 * TICK_PERIOD;
+  hostTcntStep = STEP;
+  currentstate = 1;
+  PTAD = 0x04;
+  hostWait = tick;                        /* the stop delay lets ticks run */
+  put(noise, sizeof noise);
+
+  for (i = 0; i < SERVED; i++) {
+    runTicks(30);
+    callPress(CALL_LEVEL1);
+    runTicks(20 * (i + 1));
+    irq();                                /* serves level 1 after its stop */
+    waits[i] = 20 * (i + 1) + STOP_TICKS;
+    if (i == SERVED / 2)
+      put(badFrame, sizeof badFrame);
+  }
+  runTicks(AGE_TICKS + 2 * LOAD_TICKS);   /* an AGE record after the last call */
+
+  /* wait for teledec to read everything, then hang up */
+  do {
+    usleep(10000);
+    ioctl(slave, FIONREAD, &pending);
+  } while (pending > 0);
+  usleep(100000);
+  close(master);
+  close(slave);
+
+  while ((k = read(pipefd[0], output + got, sizeof output - 1 - got)) > 0)
+    got += k;
+  output[got] = 0;
+  waitpid(pid, &status, 0);
+
+  memcpy(sorted, waits, sizeof waits);
+  qsort(sorted, SERVED, sizeof *sorted, cmpInt);
+  for (i = 0; i < SERVED; i++)
+    mean += sorted[i];
+  mean /= SERVED;
+
+  snprintf(expect[0], sizeof expect[0], "dropped 0 ");
+  snprintf(expect[1], sizeof expect[1],
+           "wait n=%d mean=%.2fs p50=%.2fs p90=%.2fs p99=%.2fs max=%.2fs",
+           SERVED, mean * 0.01, sorted[4] * 0.01, sorted[8] * 0.01,
+           sorted[9] * 0.01, sorted[9] * 0.01);
+  span = (unsigned short)(loadStart - START);
+  snprintf(expect[2], sizeof expect[2], "load windows=%u time=%.2fs",
+           span / LOAD_TICKS, span * 0.01);
+  snprintf(expect[3], sizeof expect[3], "load irq  entries=%d rate=%.1f/s busy=%.1fms",
+           SERVED, SERVED / (span * 0.01), irqBusy * 0.004);
+  snprintf(expect[4], sizeof expect[4], "load xirq entries=0 rate=0.0/s busy=0.0ms");
+  /* the tick that sends the last LOAD record adds its own time after it */
+  snprintf(expect[5], sizeof expect[5], "load tick entries=%u rate=%.1f/s busy=%.1fms",
+           loadSentCount[LOAD_TICK], loadSentCount[LOAD_TICK] / (span * 0.01),
+           STEP * (loadSentCount[LOAD_TICK] - 1 + nested) * 0.004);
+  snprintf(expect[6], sizeof expect[6], "load sci  entries=%u rate=%.1f/s busy=%.1fms",
+           loadSentCount[LOAD_SCI], loadSentCount[LOAD_SCI] / (span * 0.01),
+           STEP * loadSentCount[LOAD_SCI] * 0.004);
+  snprintf(expect[7], sizeof expect[7], "frames ");
+  /* the running figures reach the final ones with the next LOAD record */
+  snprintf(expect[8], sizeof expect[8], "STATS   %.160s  load irq ", expect[1]);
+  /* bucket n holds ages under 64 << n ticks, the last one the rest */
+  for (i = 0; i < SERVED; i++) {
+    int b = 0;
+
+    while (b < AGE_BUCKETS - 1 && waits[i] >= 64 << b)
+      b++;
+    ages[b]++;
+  }
+  len = snprintf(expect[9], sizeof expect[9], "age");
+  for (i = 0; i < AGE_BUCKETS; i++)
+    len += snprintf(expect[9] + len, sizeof expect[9] - len, " %s%.2fs %d",
+                    i < AGE_BUCKETS - 1 ? "<" : ">=",
+                    (64 << (i < AGE_BUCKETS - 1 ? i : i - 1)) * 0.01, ages[i]);
+
+  fputs(output, stdout);
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    printf("FAIL: teledec exit status %d\n", status);
+    failed = 1;
+  }
+  for (i = 0; i < 10; i++) {
+    if (!strstr(output, expect[i])) {
+      printf("FAIL: expected \"%s\"\n", expect[i]);
+      failed = 1;
+    }
+  }
+  if (strstr(output, " bad 0 ")) {
+    printf("FAIL: the corrupt frames were not seen\n");
+    failed = 1;
+  }
+  if (teleDrops != 0) {
+    printf("FAIL: the firmware dropped records\n");
+    failed = 1;
+  }
+  printf("%s\n", failed ? "teledec_test: FAIL" : "teledec_test: ok");
+  return failed;
+}
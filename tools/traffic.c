@@ -0,0 +1,248 @@
+/*
+ * traffic: a day of calls through the traffic mode classifier.
+ *
+ * Feeds call presses through main.c's own callPress, as XIRQ does, and
+ * runs TickHan every 10ms, so the classifier sees the arrivals as it
+ * would on the board. Prints every mode switch and the time spent in
+ * each mode. Use it to check the thresholds after changing them, or to
+ * retune them against calls logged from a real building.
+ *
+ *   traffic [-s seed]       a synthetic day (the default seed is 1)
+ *   traffic -w [-s seed]    write the synthetic day's calls and stop
+ *   traffic -r file         replay calls from file
+ *
+ * A call file has one press per line, "hh:mm:ss.cc call", with call one
+ * of level1 level2 level3 up1 up2 down2 down3, in time order.
+ *
+ * The synthetic day is made of trips. Each trip presses the hall call at
+ * its floor, then the level button for where it goes 20s later. Trips
+ * start as a Poisson process at the rate of the hour below. In the peaks
+ * most trips run between the lobby and the upper levels, in the morning
+ * up and in the evening down; at other times the floors are random.
+ */
+#define main firmware_main
+#include "main_host.c"
+#undef main
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TICKS_PER_HOUR 360000L
+#define DAY            (24 * TICKS_PER_HOUR)
+#define RIDE           2000              /* hall call to level button, ticks */
+#define MAXPRESSES     20000
+
+struct period {
+  double from, to;                       /* hours */
+  double trips;                          /* per hour */
+  int peak;                              /* 1 morning, 2 evening */
+};
+
+static const struct period day[] = {
+  { 0.0,  6.5,   0.3, 0},
+  { 6.5,  7.5,  10.0, 0},
+  { 7.5,  9.5, 120.0, 1},                /* morning up-peak */
+  { 9.5, 12.0,  10.0, 0},
+  {12.0, 13.5,  25.0, 0},                /* lunch */
+  {13.5, 16.5,  10.0, 0},
+  {16.5, 18.5, 120.0, 2},                /* evening down-peak */
+  {18.5, 22.0,   5.0, 0},
+  {22.0, 24.0,   0.3, 0},
+};
+
+#define PEAK_SHARE 0.85                  /* trips in the peak direction */
+
+struct press {
+  long t;
+  unsigned char call;
+};
+
+static struct press presses[MAXPRESSES];
+static int npresses;
+
+static const char *callName[CALL_COUNT] = {"level1", "level2", "level3", "up1",
+                                           "up2", "down2", "down3"};
+static const char *modeName[4] = {"idle", "up-peak", "down-peak", "interfloor"};
+
+/* xorshift, so the day is the same with every C library */
+static unsigned long long rng;
+
+static double uniform(void)
+{
+  rng ^= rng << 13;
+  rng ^= rng >> 7;
+  rng ^= rng << 17;
+  return ((rng >> 11) + 0.5) / 9007199254740992.0;
+}
+
+static void add(long t, unsigned char call)
+{
+  if (t >= DAY)
+    return;
+  if (npresses == MAXPRESSES) {
+    fprintf(stderr, "traffic: too many presses\n");
+    exit(2);
+  }
+  presses[npresses].t = t;
+  presses[npresses].call = call;
+  npresses++;
+}
+
+static void trip(long t, int from, int to)
+{
+  static const unsigned char level[4] = {0, CALL_LEVEL1, CALL_LEVEL2,
+                                         CALL_LEVEL3};
+  unsigned char hall;
+
+  if (to > from)
+    hall = (from == 1) ? CALL_UP1 : CALL_UP2;
+  else
+    hall = (from == 3) ? CALL_DOWN3 : CALL_DOWN2;
+  add(t, hall);
+  add(t + RIDE, level[to]);
+}
+
+static int byTime(const void *a, const void *b)
+{
+  const struct press *p = a, *q = b;
+
+  if (p->t != q->t)
+    return p->t < q->t ? -1 : 1;
+  return p->call - q->call;
+}
+
+static void generate(void)
+{
+  unsigned int i;
+  double t = 0;
+
+  for (i = 0; i < sizeof day / sizeof day[0]; i++) {
+    const struct period *p = &day[i];
+    double mean = TICKS_PER_HOUR / p->trips;
+
+    if (t < p->from * TICKS_PER_HOUR)
+      t = p->from * TICKS_PER_HOUR;
+    for (;;) {
+      int from, to, upper = 2 + (uniform() < 0.5);
+
+      t += -log(uniform()) * mean;
+      if (t >= p->to * TICKS_PER_HOUR)
+        break;
+      if (p->peak == 1 && uniform() < PEAK_SHARE) {
+        from = 1;
+        to = upper;
+      } else if (p->peak == 2 && uniform() < PEAK_SHARE) {
+        from = upper;
+        to = 1;
+      } else {
+        from = 1 + (int)(uniform() * 3);
+        to = 1 + (int)(uniform() * 2);
+        if (to >= from)
+          to++;
+      }
+      trip((long)t, from, to);
+    }
+    t = p->to * TICKS_PER_HOUR;
+  }
+  qsort(presses, npresses, sizeof presses[0], byTime);
+}
+
+static void hms(long t, char *s)
+{
+  sprintf(s, "%02ld:%02ld:%02ld.%02ld", t / TICKS_PER_HOUR,
+          t / 6000 % 60, t / 100 % 60, t % 100);
+}
+
+static void load(const char *file)
+{
+  FILE *f = fopen(file, "r");
+  char name[16];
+  long h, m, s, c;
+  int line = 0, i;
+
+  if (!f) {
+    perror(file);
+    exit(2);
+  }
+  while (fscanf(f, "%ld:%ld:%ld.%ld %15s", &h, &m, &s, &c, name) == 5) {
+    line++;
+    for (i = 0; i < CALL_COUNT; i++)
+      if (!strcmp(name, callName[i]))
+        break;
+    if (i == CALL_COUNT) {
+      fprintf(stderr, "%s:%d: unknown call %s\n", file, line, name);
+      exit(2);
+    }
+    add(((h * 60 + m) * 60 + s) * 100 + c, 1 << i);
+  }
+  if (!feof(f)) {
+    fprintf(stderr, "%s:%d: bad line\n", file, line + 1);
+    exit(2);
+  }
+  fclose(f);
+}
+
+int main(int argc, char **argv)
+{
+  const char *replay = 0;
+  int dump = 0, next = 0, i;
+  long t, since = 0, in[4] = {0, 0, 0, 0};
+  unsigned char mode;
+  unsigned long long seed = 1;
+  char when[32];
+
+  for (i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-w"))
+      dump = 1;
+    else if (!strcmp(argv[i], "-s") && i + 1 < argc)
+      seed = strtoull(argv[++i], 0, 0);
+    else if (!strcmp(argv[i], "-r") && i + 1 < argc)
+      replay = argv[++i];
+    else {
+      fprintf(stderr, "usage: traffic [-w] [-s seed] | traffic -r file\n");
+      return 2;
+    }
+  }
+
+  rng = seed * 2654435761ULL + 1;
+  if (replay)
+    load(replay);
+  else
+    generate();
+
+  if (dump) {
+    for (i = 0; i < npresses; i++) {
+      hms(presses[i].t, when);
+      printf("%s %s\n", when, callName[callIndex(presses[i].call)]);
+    }
+    return 0;
+  }
+
+  mode = trafficMode;
+  printf("%d calls\n\n", npresses);
+  for (t = 0; t < DAY; t++) {
+    TCNT += TICK_PERIOD;
+    TickHan();
+    teleTail = teleHead;                 /* the SCI took it all */
+    while (next < npresses && presses[next].t <= t)
+      callPress(presses[next++].call);
+    callMerge();                         /* the IRQ side takes the calls */
+    pendingCalls = 0;
+
+    if (trafficMode != mode) {
+      hms(t, when);
+      printf("%.5s %s\n", when, modeName[trafficMode]);
+      in[mode] += t - since;
+      since = t;
+      mode = trafficMode;
+    }
+  }
+  in[mode] += DAY - since;
+
+  printf("\n");
+  for (i = 0; i < 4; i++)
+    printf("%-10s %5.2fh\n", modeName[i], (double)in[i] / TICKS_PER_HOUR);
+  return 0;
+}
@@ -0,0 +1,358 @@
+/*
+ * wdbench: fault injection bench for the travel watchdog.
+ *
+ * Runs main.c's IRQHan and TickHan against a simulated car and shaft.
+ * The car moves at a speed set by the PWM duty and the direction bits in
+ * PTAD; each floor's IR sensor lights PTAD bit 2-4 while the car is near
+ * it, and IRQ fires from it while it is lit, as the level sensitive IRQ
+ * does. The stop delay's 10ms waits let simulated time pass, with the
+ * tick nested inside IRQHan as on the board. Faults are injected into
+ * the car: dead sensors and a motor that turns without moving the car.
+ *
+ * Each scenario runs in its own process, so each starts from reset, and
+ * prints its timeline and the checks it makes. The firmware's tick count
+ * starts just short of its 16 bit wrap, so every segment timer is also a
+ * check of the wrapping arithmetic.
+ *
+ *   wdbench [scenario]
+ *
+ * Exit status 1 if a check fails.
+ */
+#define main firmware_main
+#include "main_host.c"
+#undef main
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define GAP        1000.0                /* floor to floor, in shaft units */
+#define SEG_TICKS  320.0                 /* full duty segment, a little over WD_UP_TICKS */
+#define WINDOW     15.0                  /* a sensor is lit this close to its floor */
+#define BUFFER     100.0                 /* travel past a terminal floor to the buffer */
+#define FOREVER    0x7FFFFFFF
+
+struct scenario {
+  const char *name;
+  const char *what;
+  int start;                             /* floor the car is parked at */
+  unsigned char call;                    /* pressed at tick 10 */
+  unsigned char dead;                    /* dead sensors, bit n: floor n */
+  int stallFrom, stallTo;                /* ticks the car cannot move */
+  int runTicks;
+  int pressAgain;                        /* press the call again at this tick */
+  int noiseEvery;                        /* IRQ with no sensor lit this often */
+};
+
+static const struct scenario scenarios[] = {
+  {"normal", "level 1 to 3, no faults", 1, CALL_LEVEL3, 0, 0, 0, 2000, 0},
+  {"dead-middle-up", "sensor 2 dead, level 1 to 3", 1, CALL_LEVEL3, 1 << 2,
+   0, 0, 2000, 0},
+  {"dead-middle-down", "sensor 2 dead, level 3 to 1", 3, CALL_LEVEL1, 1 << 2,
+   0, 0, 2000, 0},
+  {"dead-middle-call", "sensor 2 dead, level 1 to 2", 1, CALL_LEVEL2, 1 << 2,
+   0, 0, 6000, 0},
+  {"stall-recover", "car held from 1s to 10s on the way up from level 1", 1,
+   CALL_LEVEL3, 0, 100, 1000, 4000, 0},
+  {"stall-gaveup", "car held for good from 1s", 1, CALL_LEVEL3, 0, 100,
+   FOREVER, 3000, 0},
+  {"stall-noise", "car held for good from 1s, noise on IRQ every 0.4s", 1,
+   CALL_LEVEL3, 0, 100, FOREVER, 3000, 0, 40},
+  {"terminal-up", "sensor 3 dead, level 2 to 3, pressed again at 25s", 2,
+   CALL_LEVEL3, 1 << 3, 0, 0, 4000, 2500},
+  {"terminal-down", "sensor 1 dead, level 2 to 1, pressed again at 25s", 2,
+   CALL_LEVEL1, 1 << 1, 0, 0, 4000, 2500},
+};
+
+#define NSCENARIOS (int)(sizeof scenarios / sizeof scenarios[0])
+
+/* what one run saw, for the checks */
+struct seen {
+  int stall, missed, resync, gaveup;     /* tick of the first one, -1: none */
+  int badRead;
+  int outFloor;                          /* first floor taken out of service */
+  int setOffs;                           /* times the motor started */
+  int resyncFloor;
+  int creepOn;                           /* tick WD_CREEP was entered */
+  int firstCreepDir;                     /* 1 up, 2 down */
+  int served;                            /* tick the call was served */
+  int lastStop;                          /* floor of the last stop */
+  int bufferHits;                        /* times the car ran onto a buffer */
+  int towardsOut;                        /* set offs towards a terminal floor
+                                            out of service */
+  int motorAtEnd;
+};
+
+static const struct scenario *sc;
+static struct seen seen;
+static double pos;                       /* 0: level 1, 2 * GAP: level 3 */
+static int onBuffer;
+static int now;
+static unsigned long tcnt;
+static unsigned char lastMotor, lastDuty, lastWd;
+static unsigned char frame[32];
+static int flen;
+
+static const char *wdName[6] = {"idle", "run", "pause", "creep", "back", "fault"};
+static const char *faultName[9] = {"?", "stall", "missed sensor", "resync",
+                                   "gave up", "bad sensor read",
+                                   "level 1 out of service",
+                                   "level 2 out of service",
+                                   "level 3 out of service"};
+
+static void say(const char *fmt, const char *arg, int n)
+{
+  printf("  %6.2fs  ", now * 0.01);
+  printf(fmt, arg, n);
+  printf("\n");
+}
+
+/* Read the telemetry the firmware sent, as the host would */
+static int payload(unsigned char type)
+{
+  unsigned char f = type & 0x0F;
+
+  switch (type & 0xF0) {
+  case TELE_STATE:   return (f & 1) + ((f >> 1) & 1) + ((f >> 2) & 1) + ((f >> 3) & 1);
+  case TELE_SERVICE: return 3;
+  case TELE_LOAD:    return 4 * LOAD_HANDLERS;
+  case TELE_AGE:     return 2 * AGE_BUCKETS;
+  default:           return 1;
+  }
+}
+
+static void record(const unsigned char *p, int n)
+{
+  const unsigned char *v = p + n - payload(p[0]) - 1;
+
+  switch (p[0] & 0xF0) {
+  case TELE_FAULT:
+    say("FAULT %s%.0d", faultName[v[0] < 9 ? v[0] : 0], 0);
+    if (v[0] == WD_STALL && seen.stall < 0)
+      seen.stall = now;
+    if (v[0] == WD_MISSED && seen.missed < 0)
+      seen.missed = now;
+    if (v[0] == WD_GAVEUP && seen.gaveup < 0)
+      seen.gaveup = now;
+    if (v[0] == WD_BADREAD && seen.badRead < 0)
+      seen.badRead = now;
+    if (v[0] > WD_OUT && v[0] <= WD_OUT + 3 && !seen.outFloor)
+      seen.outFloor = v[0] - WD_OUT;
+    if (v[0] == WD_RESYNC && seen.resync < 0) {
+      seen.resync = now;
+      seen.resyncFloor = button;
+    }
+    break;
+  case TELE_SERVICE:
+    if (v[0] == sc->call && seen.served < 0) {
+      seen.served = now;
+      say("call served at level %s%d", "", callFloor[callIndex(v[0])]);
+    }
+    break;
+  }
+}
+
+static void drain(void)
+{
+  while (teleTail != teleHead) {
+    frame[flen++] = teleBuf[teleTail];
+    teleTail = (teleTail + 1) & TELE_MASK;
+    if (flen >= 3) {
+      int len = 2 + (frame[2] == 0xFF ? 3 : 1) + payload(frame[1]) + 1;
+
+      if (flen == len) {
+        record(frame + 1, len - 1);
+        flen = 0;
+      }
+    }
+  }
+}
+
+static void watch(void)
+{
+  unsigned char motor = PTAD & (PTAD_PTAD7_MASK | PTAD_PTAD6_MASK);
+
+  if (motor != lastMotor || (motor && PWMDTY5 != lastDuty)) {
+    if (motor && !lastMotor) {
+      seen.setOffs++;
+      if ((seen.outFloor == 3 && motor == PTAD_PTAD7_MASK) ||
+          (seen.outFloor == 1 && motor == PTAD_PTAD6_MASK))
+        seen.towardsOut++;
+    }
+    if (!motor)
+      say("motor off%s%.0d", "", 0);
+    else
+      say("motor %s duty %d", motor == PTAD_PTAD7_MASK ? "up" : "down", PWMDTY5);
+    lastMotor = motor;
+    lastDuty = PWMDTY5;
+  }
+  if (wdState != lastWd) {
+    if (wdState != WD_RUN && wdState != WD_IDLE)
+      say("watchdog %s%.0d", wdName[wdState], 0);
+    if (wdState == WD_CREEP && seen.creepOn < 0)
+      seen.creepOn = now;
+    if ((wdState == WD_CREEP || wdState == WD_BACK) && !seen.firstCreepDir)
+      seen.firstCreepDir = motor == PTAD_PTAD7_MASK ? 1 : 2;
+    lastWd = wdState;
+  }
+}
+
+/* One 10ms tick: the car moves, the sensors follow, TC6 fires */
+static void tick(void)
+{
+  unsigned char motor = PTAD & (PTAD_PTAD7_MASK | PTAD_PTAD6_MASK);
+  unsigned char lit = 0;
+  int f;
+
+  now++;
+  if (motor && !(now >= sc->stallFrom && now < sc->stallTo)) {
+    if (motor == PTAD_PTAD7_MASK)
+      pos += PWMDTY5 * GAP / SEG_TICKS / 225;
+    else
+      pos -= PWMDTY5 * GAP / SEG_TICKS / 190;
+  }
+  if (pos >= 2 * GAP + BUFFER || pos <= -BUFFER) {
+    pos = pos > 0 ? 2 * GAP + BUFFER : -BUFFER;
+    if (!onBuffer)
+      seen.bufferHits++;
+    onBuffer = 1;
+  } else {
+    onBuffer = 0;
+  }
+
+  for (f = 1; f <= 3; f++)
+    if (fabs(pos - (f - 1) * GAP) <= WINDOW && !(sc->dead & (1 << f)))
+      lit |= 1 << (f + 1);
+  PTAD = (PTAD & ~0x1C) | lit;
+
+  tcnt += TICK_PERIOD;
+  hostTcnt = (unsigned short)tcnt;
+  TickHan();
+  if (now == 10 || now == sc->pressAgain)
+    callPress(sc->call);
+  drain();
+  watch();
+}
+
+static void run(void)
+{
+
+  memset(&seen, 0, sizeof seen);
+  seen.stall = seen.missed = seen.resync = seen.gaveup = seen.badRead = -1;
+  seen.creepOn = seen.served = -1;
+  ticks = teleLast = loadStart = trafficStart = 0x10000 - 200;
+  currentstate = sc->start;
+  pos = (sc->start - 1) * GAP;
+  INTCR = 0x40;
+  hostWait = tick;                       /* the stop delay lets time pass */
+
+  while (now < sc->runTicks) {
+    tick();
+    if (((PTAD & 0x1C) || (sc->noiseEvery && now > 10 && now % sc->noiseEvery == 0))
+        && INTCR == 0x40) {
+      IRQHan();                          /* the level sensitive IRQ */
+      drain();
+      watch();
+      if (direction == 0)
+        seen.lastStop = button;
+    }
+  }
+  seen.motorAtEnd = PTAD & (PTAD_PTAD7_MASK | PTAD_PTAD6_MASK);
+}
+
+static int fails;
+
+static void check(int ok, const char *what)
+{
+  printf("  %s %s\n", ok ? "ok  " : "FAIL", what);
+  if (!ok)
+    fails++;
+}
+
+static void checks(void)
+{
+  const char *n = sc->name;
+  int limit;
+
+  printf("  --\n");
+  if (!strcmp(n, "normal")) {
+    check(seen.stall < 0 && seen.missed < 0, "no fault on a healthy run");
+    check(seen.served >= 0 && seen.lastStop == 3, "served at level 3");
+  } else if (!strcmp(n, "dead-middle-call")) {
+    check(seen.missed >= 0, "missed sensor reported");
+    check(seen.outFloor == 2, "level 2 taken out of service");
+    check(seen.served < 0, "the call was dropped, not served");
+    check(seen.setOffs == WD_MISS_LIMIT, "one set off per miss, then no more");
+    check(seen.motorAtEnd == 0, "motor left off");
+  } else if (!strncmp(n, "dead-middle", 11)) {
+    check(seen.missed >= 0, "missed sensor reported");
+    check(seen.stall < 0, "no stall: the next sensor beat the limit");
+    check(seen.served >= 0, "call served");
+  } else if (!strcmp(n, "stall-recover")) {
+    check(seen.stall >= 0, "stall reported");
+    limit = 3 * WD_UP_TICKS + 100;
+    check(seen.stall >= 0 && seen.stall < sc->stallFrom + limit,
+          "stall seen within the segment limit");
+    check(seen.resync >= 0, "a floor was found while recovering");
+    check(seen.gaveup < 0, "recovery did not give up");
+    check(seen.served >= 0, "call served after recovery");
+  } else if (!strcmp(n, "stall-noise")) {
+    check(seen.badRead >= 0, "bad sensor read reported");
+    limit = 3 * WD_UP_TICKS + 100;
+    check(seen.stall >= 0 && seen.stall < sc->stallFrom + limit,
+          "the noise did not hide the stall");
+    check(seen.gaveup >= 0, "recovery gave up");
+    check(seen.motorAtEnd == 0, "motor left off");
+  } else if (!strcmp(n, "stall-gaveup")) {
+    check(seen.stall >= 0, "stall reported");
+    check(seen.gaveup >= 0, "recovery gave up");
+    limit = 3 * WD_UP_TICKS + WD_PAUSE_TICKS + WD_CREEP_TICKS + WD_BACK_TICKS + 100;
+    check(seen.gaveup >= 0 && seen.gaveup < sc->stallFrom + limit,
+          "gave up within the recovery bound");
+    check(seen.motorAtEnd == 0, "motor left off");
+  } else {
+    int back = sc->call == CALL_LEVEL3 ? 2 : 1;
+
+    check(seen.stall >= 0, "overrun past the terminal floor reported");
+    check(seen.creepOn < 0, "no creep on past the terminal floor");
+    check(seen.firstCreepDir == back, "first creep heads back");
+    check(seen.resync >= 0 && seen.resyncFloor == 2,
+          "found level 2, the floor it came from");
+    check(seen.outFloor == callFloor[callIndex(sc->call)],
+          "the terminal floor taken out of service");
+    check(seen.bufferHits <= 1, "ran onto the buffer at most once");
+    check(seen.towardsOut == 0, "never set off towards it again");
+    check(seen.served < 0, "its call dropped, not served");
+    check(seen.motorAtEnd == 0, "motor left off");
+  }
+}
+
+int main(int argc, char **argv)
+{
+  int i, status, failed = 0;
+
+  for (i = 0; i < NSCENARIOS; i++) {
+    pid_t pid;
+
+    if (argc > 1 && strcmp(argv[1], scenarios[i].name) != 0)
+      continue;
+    fflush(stdout);
+    pid = fork();
+    if (pid == 0) {
+      sc = &scenarios[i];
+      printf("%s: %s\n", sc->name, sc->what);
+      run();
+      checks();
+      printf("\n");
+      exit(fails != 0);
+    }
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+      failed = 1;
+  }
+  printf("wdbench: %s\n", failed ? "FAIL" : "ok");
+  return failed;
+}